@@ -0,0 +1,64 @@
+#include "BlockFifo.h"
+
+// Room for this many bytes of MIDI a block before the buffer has to grow.
+static const size_t kReservedMidiBytes = 4096;
+
+void
+BlockFifo::prepare(int numChannels, int blockSize)
+{
+	if (!isPreparedFor(numChannels, blockSize)) {
+		myInput.setSize(numChannels, blockSize);
+		myOutput.setSize(numChannels, blockSize);
+		myMidiBuffer.ensureSize(kReservedMidiBytes);
+		myBlockSize = blockSize;
+	}
+
+	reset();
+}
+
+void
+BlockFifo::reset()
+{
+	myInput.clear();
+	myOutput.clear();
+	startNextBlock();
+}
+
+void
+BlockFifo::startNextBlock()
+{
+	myMidiBuffer.clear();
+	myPosition = 0;
+}
+
+bool
+BlockFifo::exchange(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples)
+{
+	using namespace juce;
+
+	jassert(numSamples <= getNumSamplesToFill());
+
+	for (int chan = 0; chan < numOutputChannels; chan++)
+	{
+		if (chan < myOutput.getNumChannels()) {
+			FloatVectorOperations::copy(output[chan], myOutput.getReadPointer(chan, myPosition), numSamples);
+		}
+		else {
+			FloatVectorOperations::clear(output[chan], numSamples);
+		}
+	}
+
+	for (int chan = 0; chan < myInput.getNumChannels(); chan++)
+	{
+		if (input && chan < numInputChannels) {
+			myInput.copyFrom(chan, myPosition, input[chan], numSamples);
+		}
+		else {
+			myInput.clear(chan, myPosition, numSamples);
+		}
+	}
+
+	myPosition += numSamples;
+
+	return myPosition == myBlockSize;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+// Regroups audio arriving in blocks of any size into blocks of exactly
+// blockSize samples, for plugins that can't handle a varying block size.
+//
+// Input and MIDI collect in one buffer while output is read from another,
+// which holds the block rendered last. Once the input buffer is full, it's
+// rendered into the output buffer and the next block starts. The output
+// therefore lags the input by exactly blockSize samples.
+//
+// The storage is only reallocated when the channel count or block size changes.
+class BlockFifo
+{
+public:
+	// Clears the FIFO, reallocating if the channel count or block size changed.
+	void prepare(int numChannels, int blockSize);
+
+	bool isPreparedFor(int numChannels, int blockSize) const
+	{
+		return numChannels == myInput.getNumChannels() && blockSize == myBlockSize;
+	}
+
+	// Clears both buffers and starts a new block.
+	void reset();
+
+	int getBlockSize() const { return myBlockSize; }
+	int getLatencySamples() const { return myBlockSize; }
+
+	// How many samples fit before the block is full.
+	int getNumSamplesToFill() const { return myBlockSize - myPosition; }
+
+	// Where the next sample lands in the block.
+	int getPosition() const { return myPosition; }
+
+	// Adds MIDI timed from the current position, before the audio that goes
+	// with it is exchanged.
+	void addMidi(const juce::MidiBuffer& midiBuffer) { myMidiBuffer.addEvents(midiBuffer, 0, -1, myPosition); }
+
+	// Reads numSamples of output and writes the same number of input (or
+	// silence for channels missing from input, or all of them when input is
+	// nullptr). numSamples must fit in the block. Returns true when the block
+	// is full and needs rendering.
+	bool exchange(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples);
+
+	// The full block, to be rendered from getBlockInput() into getBlockOutput(),
+	// and then handed back with startNextBlock().
+	const float* const* getBlockInput() const { return myInput.getArrayOfReadPointers(); }
+	float* const* getBlockOutput() { return myOutput.getArrayOfWritePointers(); }
+	const juce::MidiBuffer& getBlockMidi() const { return myMidiBuffer; }
+	int getNumChannels() const { return myInput.getNumChannels(); }
+
+	void startNextBlock();
+
+private:
+
+	juce::AudioBuffer<float> myInput;
+	juce::AudioBuffer<float> myOutput;
+	juce::MidiBuffer myMidiBuffer;
+	int myBlockSize = 0;
+	int myPosition = 0;
+};
@@ -0,0 +1,180 @@
+#include "CatchUpBudget.h"
+
+void
+CatchUpBudget::prepare(int numChannels, int maximumBlockSize)
+{
+	if (numChannels > myLastBlock.getNumChannels() || maximumBlockSize > myLastBlock.getNumSamples()) {
+		myLastBlock.setSize(std::max(numChannels, myLastBlock.getNumChannels()), std::max(maximumBlockSize, myLastBlock.getNumSamples()));
+		reset();
+	}
+}
+
+void
+CatchUpBudget::reset()
+{
+	myLastBlock.clear();
+	myLastBlockLength = 0;
+	myFadeLength = 0;
+	myLoopPosition = 0;
+	myLoopIsFadingOut = false;
+}
+
+void
+CatchUpBudget::startCook(double budgetSeconds, Shortfall shortfall)
+{
+	myBudgetSeconds = budgetSeconds;
+	myShortfall = shortfall;
+	myCookStartTicks = juce::Time::getHighResolutionTicks();
+	myNumBlocksThisCook = 0;
+}
+
+bool
+CatchUpBudget::canRender(int numSamples) const
+{
+	if (myNumBlocksThisCook == 0) {
+		return true;
+	}
+
+	const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - myCookStartTicks);
+	return elapsed + getExpectedCost(numSamples) <= myBudgetSeconds;
+}
+
+void
+CatchUpBudget::addRenderCost(int numSamples, double seconds)
+{
+	if (numSamples <= 0) {
+		return;
+	}
+
+	const double secondsPerSample = seconds / numSamples;
+
+	// Rises quickly so a plugin that gets expensive is caught within a block or
+	// two, and falls slowly so one cheap block doesn't undo that.
+	if (mySecondsPerSample == 0.) {
+		mySecondsPerSample = secondsPerSample;
+	}
+	else {
+		const double weight = secondsPerSample > mySecondsPerSample ? 0.5 : 0.05;
+		mySecondsPerSample += weight * (secondsPerSample - mySecondsPerSample);
+	}
+}
+
+float
+CatchUpBudget::getLoopSample(int chan, int position) const
+{
+	const float* block = myLastBlock.getReadPointer(chan);
+	const int fadeStart = myLastBlockLength - myFadeLength;
+
+	if (position < fadeStart) {
+		return block[position];
+	}
+
+	// The end of the block fades into the start, so the loop can jump back
+	// to just after the fade without a click.
+	const int fadePosition = position - fadeStart;
+	const float gain = (float)(fadePosition + 1) / (float)(myFadeLength + 1);
+
+	return block[position] * (1.f - gain) + block[fadePosition] * gain;
+}
+
+void
+CatchUpBudget::blockOutput(float* const* channels, int numChannels, int numSamples)
+{
+	using namespace juce;
+
+	myNumBlocksThisCook++;
+
+	numChannels = std::min(numChannels, myLastBlock.getNumChannels());
+	numSamples = std::min(numSamples, myLastBlock.getNumSamples());
+
+	if (myLoopIsFadingOut) {
+		const int numFadeSamples = std::min(myFadeLength, numSamples);
+
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			int position = myLoopPosition;
+
+			for (int samp = 0; samp < numFadeSamples; samp++)
+			{
+				const float gain = (float)(samp + 1) / (float)(myFadeLength + 1);
+				channels[chan][samp] = channels[chan][samp] * gain + getLoopSample(chan, position) * (1.f - gain);
+
+				if (++position == myLastBlockLength) {
+					position = myFadeLength;
+				}
+			}
+		}
+
+		myLoopIsFadingOut = false;
+	}
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		FloatVectorOperations::copy(myLastBlock.getWritePointer(chan), channels[chan], numSamples);
+	}
+
+	myLastBlockLength = numSamples;
+}
+
+void
+CatchUpBudget::fillShortfall(float* const* channels, int numChannels, int startSample, int numSamples)
+{
+	using namespace juce;
+
+	const int numFillSamples = numSamples - startSample;
+
+	if (numFillSamples <= 0) {
+		return;
+	}
+
+	myOverloadCount++;
+	mySkippedSamples += numFillSamples;
+
+	if (myShortfall == Silence || myLastBlockLength == 0) {
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			FloatVectorOperations::clear(channels[chan] + startSample, numFillSamples);
+		}
+		return;
+	}
+
+	// A repeat loops the whole block, while a crossfaded loop skips the part
+	// of the block its seam fades into.
+	myFadeLength = myShortfall == Crossfade ? std::min(kFadeSamples, myLastBlockLength / 2) : 0;
+
+	const int loopStart = myFadeLength;
+	const int numLoopChannels = std::min(numChannels, myLastBlock.getNumChannels());
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		float* dest = channels[chan];
+
+		if (chan >= numLoopChannels) {
+			FloatVectorOperations::clear(dest + startSample, numFillSamples);
+			continue;
+		}
+
+		// The block already in the output gets the first seam, which is
+		// continuous with the samples before it.
+		for (int samp = 0; samp < myFadeLength; samp++)
+		{
+			dest[startSample - myFadeLength + samp] = getLoopSample(chan, myLastBlockLength - myFadeLength + samp);
+		}
+
+		int position = loopStart;
+
+		for (int samp = startSample; samp < numSamples; samp++)
+		{
+			dest[samp] = getLoopSample(chan, position);
+
+			if (++position == myLastBlockLength) {
+				position = loopStart;
+			}
+		}
+
+		myLoopPosition = position;
+	}
+
+	// Repeats cut straight back to the plugin.
+	myLoopIsFadingOut = myFadeLength > 0;
+}
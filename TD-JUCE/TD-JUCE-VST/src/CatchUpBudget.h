@@ -0,0 +1,79 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+// Caps how long a cook spends rendering, so a cook that has to catch up after
+// dropped frames doesn't run long enough to drop the next frame too.
+//
+// The cost of rendering a sample is measured as blocks render, and a block is
+// only started if it's expected to finish within the budget. Whatever part of
+// the cook doesn't fit is filled from the last block of output instead, and
+// the cook counts as an overload. The first block of a cook always renders, so
+// the plugin never stalls completely.
+class CatchUpBudget
+{
+public:
+	// How the part of a cook that wasn't rendered gets filled.
+	enum Shortfall
+	{
+		Silence = 0,
+		Repeat,     // loops the last block
+		Crossfade   // loops the last block with crossfaded seams, and fades back into the next rendered block
+	};
+
+	// Makes room for a block of output. Only reallocates when either grows.
+	void prepare(int numChannels, int maximumBlockSize);
+
+	// Forgets the last block, leaving the cost estimate and counts alone.
+	void reset();
+
+	// Starts timing a cook that may spend up to budgetSeconds rendering.
+	void startCook(double budgetSeconds, Shortfall shortfall);
+
+	// True if a block of numSamples is expected to finish within the budget.
+	bool canRender(int numSamples) const;
+
+	// Called each time the plugin has rendered numSamples, with how long it took.
+	void addRenderCost(int numSamples, double seconds);
+
+	// Called with every block of output once it's final. Fades in from the
+	// previous cook's shortfall, if it was crossfaded, and keeps the block to fill
+	// shortfalls with.
+	void blockOutput(float* const* channels, int numChannels, int numSamples);
+
+	// Fills the channels from startSample to numSamples and counts an overload.
+	void fillShortfall(float* const* channels, int numChannels, int startSample, int numSamples);
+
+	int32_t getOverloadCount() const { return myOverloadCount; }
+	int64_t getSkippedSamples() const { return mySkippedSamples; }
+
+	// The estimated time to render a block of numSamples.
+	double getExpectedCost(int numSamples) const { return mySecondsPerSample * numSamples; }
+
+private:
+
+	// How many samples each seam of a crossfaded loop takes, at most.
+	static const int kFadeSamples = 64;
+
+	// The sample at position of the looped last block.
+	float getLoopSample(int chan, int position) const;
+
+	juce::AudioBuffer<float> myLastBlock;
+	int myLastBlockLength = 0;
+	int myFadeLength = 0;
+
+	// Where the loop left off, when the next block fades in from it.
+	int myLoopPosition = 0;
+	bool myLoopIsFadingOut = false;
+
+	Shortfall myShortfall = Silence;
+	double myBudgetSeconds = 0.;
+	juce::int64 myCookStartTicks = 0;
+	int myNumBlocksThisCook = 0;
+
+	// Smoothed over recent blocks, as the cost varies with what the plugin is doing.
+	double mySecondsPerSample = 0.;
+
+	int32_t myOverloadCount = 0;
+	int64_t mySkippedSamples = 0;
+};
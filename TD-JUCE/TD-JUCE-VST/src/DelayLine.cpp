@@ -0,0 +1,119 @@
+#include "DelayLine.h"
+
+void
+DelayLine::prepare(int numChannels, int maximumDelay)
+{
+	if (numChannels <= myBuffer.getNumChannels() && maximumDelay <= myMaximumDelay) {
+		return;
+	}
+
+	myMaximumDelay = std::max(maximumDelay, myMaximumDelay);
+	myBuffer.setSize(std::max(numChannels, myBuffer.getNumChannels()), myMaximumDelay + kChunkSize);
+	reset();
+}
+
+void
+DelayLine::reset()
+{
+	myBuffer.clear();
+	myWritePosition = 0;
+}
+
+void
+DelayLine::write(const float* const* input, int numInputChannels, int start, int numSamples)
+{
+	using namespace juce;
+
+	const int size = myBuffer.getNumSamples();
+	const int size1 = std::min(numSamples, size - myWritePosition);
+	const int size2 = numSamples - size1;
+
+	for (int chan = 0; chan < myBuffer.getNumChannels(); chan++)
+	{
+		float* dest = myBuffer.getWritePointer(chan);
+
+		// With no input the line still moves on, carrying silence.
+		if (numInputChannels <= 0) {
+			FloatVectorOperations::clear(dest + myWritePosition, size1);
+			FloatVectorOperations::clear(dest, size2);
+			continue;
+		}
+
+		const float* source = input[std::min(chan, numInputChannels - 1)] + start;
+
+		FloatVectorOperations::copy(dest + myWritePosition, source, size1);
+		FloatVectorOperations::copy(dest, source + size1, size2);
+	}
+
+	myWritePosition = (myWritePosition + numSamples) % size;
+}
+
+int
+DelayLine::getReadPosition(int numSamples, int delay) const
+{
+	const int size = myBuffer.getNumSamples();
+	return ((myWritePosition - numSamples - delay) % size + size) % size;
+}
+
+void
+DelayLine::process(float* const* channels, int numChannels, int numSamples, int delay)
+{
+	using namespace juce;
+
+	delay = jlimit(0, myMaximumDelay, delay);
+
+	const int size = myBuffer.getNumSamples();
+	const int numDelayedChannels = std::min(numChannels, myBuffer.getNumChannels());
+
+	// The whole chunk is written before any of it is read back, so this can
+	// work in place.
+	for (int start = 0; start < numSamples; start += kChunkSize)
+	{
+		const int chunk = std::min(kChunkSize, numSamples - start);
+
+		write(channels, numChannels, start, chunk);
+
+		const int readPosition = getReadPosition(chunk, delay);
+		const int size1 = std::min(chunk, size - readPosition);
+
+		for (int chan = 0; chan < numDelayedChannels; chan++)
+		{
+			const float* source = myBuffer.getReadPointer(chan);
+			float* dest = channels[chan] + start;
+
+			FloatVectorOperations::copy(dest, source + readPosition, size1);
+			FloatVectorOperations::copy(dest + size1, source, chunk - size1);
+		}
+	}
+}
+
+void
+DelayLine::addDelayed(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels,
+	int numSamples, int delay, float gain)
+{
+	using namespace juce;
+
+	delay = jlimit(0, myMaximumDelay, delay);
+	numOutputChannels = std::min(numOutputChannels, myBuffer.getNumChannels());
+
+	const int size = myBuffer.getNumSamples();
+
+	for (int start = 0; start < numSamples; start += kChunkSize)
+	{
+		const int chunk = std::min(kChunkSize, numSamples - start);
+
+		write(input, numInputChannels, start, chunk);
+
+		const int readPosition = getReadPosition(chunk, delay);
+		const int size1 = std::min(chunk, size - readPosition);
+
+		for (int chan = 0; chan < numOutputChannels; chan++)
+		{
+			const float* source = myBuffer.getReadPointer(chan);
+			float* dest = output[chan] + start;
+
+			FloatVectorOperations::addWithMultiply(dest, source + readPosition, gain, size1);
+			FloatVectorOperations::addWithMultiply(dest + size1, source, gain, chunk - size1);
+		}
+	}
+}
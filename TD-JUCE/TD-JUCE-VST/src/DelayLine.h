@@ -0,0 +1,46 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+// A multichannel circular delay line with a variable delay, used to line the
+// dry signal and the output up with a plugin's latency.
+//
+// The storage is only reallocated when the channel count or maximum delay
+// grows. Changing the delay jumps straight to the new one.
+class DelayLine
+{
+public:
+	// Makes room for delays up to maximumDelay samples, clearing the line if
+	// it has to grow.
+	void prepare(int numChannels, int maximumDelay);
+
+	int getMaximumDelay() const { return myMaximumDelay; }
+
+	// Clears the line.
+	void reset();
+
+	// Delays channels in place.
+	void process(float* const* channels, int numChannels, int numSamples, int delay);
+
+	// Feeds input through the line and adds its output, times gain, to output.
+	// Channels missing from input repeat its last channel, and are silent if
+	// input has no channels.
+	void addDelayed(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels,
+		int numSamples, int delay, float gain);
+
+private:
+
+	// How many samples go through the line at once, on top of the maximum delay.
+	static const int kChunkSize = 512;
+
+	// Writes numSamples of input, from start, to every channel of the line.
+	void write(const float* const* input, int numInputChannels, int start, int numSamples);
+
+	// Position of the sample delay samples before the next one to be written,
+	// assuming numSamples have just been written.
+	int getReadPosition(int numSamples, int delay) const;
+
+	juce::AudioBuffer<float> myBuffer;
+	int myWritePosition = 0;
+	int myMaximumDelay = 0;
+};
@@ -0,0 +1,114 @@
+#include "MidiEventList.h"
+
+#include <string.h>
+
+static const char* kFieldNames[] = { "note", "velocity", "channel", "offset", "type" };
+
+static int
+toMidiValue(float value)
+{
+	return juce::jlimit(0, 127, juce::roundToInt(value * 127.f));
+}
+
+MidiEventList::MidiEventList()
+{
+	myEvents.ensureSize(4096);
+}
+
+void
+MidiEventList::read(const OP_CHOPInput* eventCHOP, int numSamples, bool readAgain)
+{
+	using namespace juce;
+
+	myEvents.clear();
+	myNumEvents = 0;
+
+	if (eventCHOP->totalCooks == myLastTotalCooks && !readAgain) {
+		return;
+	}
+	myLastTotalCooks = eventCHOP->totalCooks;
+
+	const float* fields[NumFields] = {};
+	bool foundByName = false;
+
+	for (int chan = 0; chan < eventCHOP->numChannels; chan++)
+	{
+		for (int field = 0; field < NumFields; field++)
+		{
+			if (!strcmp(eventCHOP->getChannelName(chan), kFieldNames[field])) {
+				fields[field] = eventCHOP->getChannelData(chan);
+				foundByName = true;
+			}
+		}
+	}
+
+	if (!foundByName) {
+		for (int field = 0; field < std::min((int)NumFields, (int)eventCHOP->numChannels); field++)
+		{
+			fields[field] = eventCHOP->getChannelData(field);
+		}
+	}
+
+	myHasChannels = fields[ChannelField] != nullptr;
+
+	if (!fields[NoteField] && !fields[VelocityField]) {
+		return;
+	}
+
+	for (int i = 0; i < eventCHOP->numSamples; i++)
+	{
+		const int note = fields[NoteField] ? jlimit(0, 127, roundToInt(fields[NoteField][i])) : 0;
+		const float value = fields[VelocityField] ? fields[VelocityField][i] : 0.f;
+		const int channel = fields[ChannelField] ? jlimit(1, 16, roundToInt(fields[ChannelField][i])) : 1;
+		const int offset = fields[OffsetField] ? jlimit(0, std::max(0, numSamples - 1), roundToInt(fields[OffsetField][i])) : 0;
+		const int type = fields[TypeField] ? roundToInt(fields[TypeField][i]) : Note;
+
+		switch (type)
+		{
+		case Note:
+		{
+			const float velocity = jlimit(0.f, 1.f, value);
+			myEvents.addEvent(velocity > 0.f ? MidiMessage::noteOn(channel, note, velocity) : MidiMessage::noteOff(channel, note, velocity), offset);
+			break;
+		}
+		case ControlChange:
+			myEvents.addEvent(MidiMessage::controllerEvent(channel, note, toMidiValue(value)), offset);
+			break;
+		case PitchBend:
+			myEvents.addEvent(MidiMessage::pitchWheel(channel, jlimit(0, 16383, roundToInt((value + 1.f) * 8192.f))), offset);
+			break;
+		case Aftertouch:
+			myEvents.addEvent(MidiMessage::aftertouchChange(channel, note, toMidiValue(value)), offset);
+			break;
+		case ChannelPressure:
+			myEvents.addEvent(MidiMessage::channelPressureChange(channel, toMidiValue(value)), offset);
+			break;
+		default:
+			continue;
+		}
+
+		myNumEvents++;
+	}
+}
+
+void
+MidiEventList::addBlockTo(juce::MidiBuffer& midi, int startSample, int numSamples, int channel) const
+{
+	if (myNumEvents == 0) {
+		return;
+	}
+
+	if (channel <= 0) {
+		midi.addEvents(myEvents, startSample, numSamples, -startSample);
+		return;
+	}
+
+	// Every event here is a channel message, with the channel in the status byte's low bits.
+	for (const auto metadata : myEvents)
+	{
+		if (metadata.samplePosition >= startSample && metadata.samplePosition < startSample + numSamples &&
+			(metadata.data[0] & 0x0f) + 1 == channel) {
+			midi.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition - startSample);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CHOP_CPlusPlusBase.h"
+
+#include "JuceHeader.h"
+
+// Reads a CHOP where every sample is one MIDI event, as an alternative to
+// 128 channels of note velocities. The channels are:
+//
+//   note      note number, or controller number for control changes
+//   velocity  0 to 1. Note velocity (0 is a note off), controller value,
+//             aftertouch amount, or -1 to 1 for pitch bend
+//   channel   MIDI channel, 1 to 16 (default 1)
+//   offset    sample offset into the cook's output (default 0)
+//   type      0 note, 1 control change, 2 pitch bend, 3 aftertouch,
+//             4 channel pressure (default 0)
+//
+// Channels are found by name. If none of the names match, they're read in the
+// order above. The events are sent once each time the event CHOP cooks.
+class MidiEventList
+{
+public:
+	enum EventType
+	{
+		Note = 0,
+		ControlChange,
+		PitchBend,
+		Aftertouch,
+		ChannelPressure
+	};
+
+	MidiEventList();
+
+	// Converts the event CHOP into MIDI for a cook of numSamples. If the CHOP
+	// hasn't cooked since the last call there are no new events, unless
+	// readAgain is set, as for an offline render that starts over.
+	void read(const OP_CHOPInput* eventCHOP, int numSamples, bool readAgain = false);
+
+	// Adds the events in [startSample, startSample + numSamples) to midi,
+	// timestamped relative to startSample. With channel above 0, only the
+	// events on that MIDI channel are added.
+	void addBlockTo(juce::MidiBuffer& midi, int startSample, int numSamples, int channel = 0) const;
+
+	int getNumEvents() const { return myNumEvents; }
+
+	// True if the event CHOP has a channel field.
+	bool hasChannels() const { return myHasChannels; }
+
+private:
+
+	enum Field
+	{
+		NoteField = 0,
+		VelocityField,
+		ChannelField,
+		OffsetField,
+		TypeField,
+		NumFields
+	};
+
+	// Events for the current cook, timestamped from the start of the cook.
+	juce::MidiBuffer myEvents;
+	int myNumEvents = 0;
+	bool myHasChannels = false;
+
+	int64_t myLastTotalCooks = -1;
+};
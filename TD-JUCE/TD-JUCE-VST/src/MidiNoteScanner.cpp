@@ -0,0 +1,83 @@
+#include "MidiNoteScanner.h"
+
+// Once a span is known to contain a transition, it's narrowed down in chunks
+// of this many samples before falling back to a scalar search.
+static const int kScanChunkSize = 64;
+
+// Returns the index of the first sample in [start, end) that turns a note on
+// (isOn == false) or off (isOn == true), or end if there isn't one.
+static int
+findTransition(const float* data, int start, int end, bool isOn)
+{
+	using namespace juce;
+
+	// Most of the time a note holds its state for the whole block.
+	if (start >= end) {
+		return end;
+	}
+
+	if (isOn ? FloatVectorOperations::findMinimum(data + start, end - start) > 0.f
+			 : FloatVectorOperations::findMaximum(data + start, end - start) <= 0.f) {
+		return end;
+	}
+
+	for (int chunkStart = start; chunkStart < end; chunkStart += kScanChunkSize)
+	{
+		const int chunkEnd = std::min(chunkStart + kScanChunkSize, end);
+		const int chunkSize = chunkEnd - chunkStart;
+
+		if (isOn ? FloatVectorOperations::findMinimum(data + chunkStart, chunkSize) > 0.f
+				 : FloatVectorOperations::findMaximum(data + chunkStart, chunkSize) <= 0.f) {
+			continue;
+		}
+
+		for (int samp = chunkStart; samp < chunkEnd; samp++)
+		{
+			if ((data[samp] > 0.f) != isOn) {
+				return samp;
+			}
+		}
+	}
+
+	return end;
+}
+
+MidiNoteScanner::MidiNoteScanner()
+{
+	reset();
+}
+
+void
+MidiNoteScanner::reset()
+{
+	for (size_t i = 0; i < 128; i++)
+	{
+		myActiveNotes[i] = false;
+	}
+}
+
+void
+MidiNoteScanner::scan(const OP_CHOPInput* velocityCHOP, int startSample, int numSamples, juce::MidiBuffer& midi, int firstChannel)
+{
+	const int maxSamp = std::min(startSample + numSamples, velocityCHOP->numSamples);
+
+	for (int note = 0; note < std::min(128, velocityCHOP->numChannels - firstChannel); note++)
+	{
+		const float* data = velocityCHOP->getChannelData(firstChannel + note);
+
+		int samp = findTransition(data, startSample, maxSamp, myActiveNotes[note]);
+
+		while (samp < maxSamp)
+		{
+			const float velocity = std::min(1.f, std::max(0.f, data[samp]));  // clamp 0 to 1
+			const bool isOn = velocity > 0.f;
+
+			juce::MidiMessage message = isOn ? juce::MidiMessage::noteOn(1, note, velocity) : juce::MidiMessage::noteOff(1, note, velocity);
+
+			midi.addEvent(message, samp - startSample);
+			myActiveNotes[note] = isOn;
+
+			samp = findTransition(data, samp + 1, maxSamp, isOn);
+		}
+	}
+}
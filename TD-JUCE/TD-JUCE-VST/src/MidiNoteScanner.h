@@ -0,0 +1,29 @@
+#pragma once
+
+#include "CHOP_CPlusPlusBase.h"
+
+#include "JuceHeader.h"
+
+// Turns a CHOP of 128 note velocity channels into MIDI note on/off events.
+//
+// A note turns on when its velocity goes above 0 and off when it returns to 0.
+// Rather than testing every sample of every channel, each channel is checked
+// with vectorized min/max passes, so spans without a transition are skipped.
+class MidiNoteScanner
+{
+public:
+	MidiNoteScanner();
+
+	// Forgets which notes are held, without sending note offs.
+	void reset();
+
+	// Adds the transitions in [startSample, startSample + numSamples) of the
+	// velocity channels to midi, timestamped relative to startSample.
+	// Events come out in the same order as a sample-by-sample scan would give.
+	// The 128 notes are read from the channels starting at firstChannel.
+	void scan(const OP_CHOPInput* velocityCHOP, int startSample, int numSamples, juce::MidiBuffer& midi, int firstChannel = 0);
+
+private:
+
+	bool myActiveNotes[128];
+};
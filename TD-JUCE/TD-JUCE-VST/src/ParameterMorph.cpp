@@ -0,0 +1,128 @@
+#include "ParameterMorph.h"
+
+void
+ParameterMorph::setParameters(const std::vector<bool>& isDiscrete)
+{
+	myNumParameters = (int)isDiscrete.size();
+	mySnapshots.assign((size_t)kNumSnapshots * myNumParameters, 0.f);
+
+	myDiscreteParameters.clear();
+
+	for (int i = 0; i < myNumParameters; i++)
+	{
+		if (isDiscrete[i]) {
+			myDiscreteParameters.push_back(i);
+		}
+	}
+
+	std::fill(std::begin(myHasSnapshot), std::end(myHasSnapshot), false);
+}
+
+void
+ParameterMorph::capture(int slot, const float* values)
+{
+	if (slot < 0 || slot >= kNumSnapshots || myNumParameters == 0) {
+		return;
+	}
+
+	juce::FloatVectorOperations::copy(mySnapshots.data() + (size_t)slot * myNumParameters, values, myNumParameters);
+	myHasSnapshot[slot] = true;
+}
+
+bool
+ParameterMorph::blend(const int* slots, const float* weights, int numSlots, float* output) const
+{
+	using namespace juce;
+
+	float totalWeight = 0.f;
+	int heaviest = -1;
+
+	for (int i = 0; i < numSlots; i++)
+	{
+		totalWeight += weights[i];
+
+		if (heaviest < 0 || weights[i] > weights[heaviest]) {
+			heaviest = i;
+		}
+	}
+
+	if (numSlots == 0 || totalWeight <= 0.f) {
+		return false;
+	}
+
+	// Weights are normalized so that leaving out a slot doesn't pull toward 0.
+	FloatVectorOperations::copyWithMultiply(output, getSnapshot(slots[0]), weights[0] / totalWeight, myNumParameters);
+
+	for (int i = 1; i < numSlots; i++)
+	{
+		if (weights[i] > 0.f) {
+			FloatVectorOperations::addWithMultiply(output, getSnapshot(slots[i]), weights[i] / totalWeight, myNumParameters);
+		}
+	}
+
+	const float* nearest = getSnapshot(slots[heaviest]);
+
+	for (int parameter : myDiscreteParameters)
+	{
+		output[parameter] = nearest[parameter];
+	}
+
+	return true;
+}
+
+bool
+ParameterMorph::morphLinear(float position, int numSlots, float* output) const
+{
+	int slots[kNumSnapshots];
+	int numCaptured = 0;
+
+	for (int slot = 0; slot < std::min(numSlots, (int)kNumSnapshots); slot++)
+	{
+		if (myHasSnapshot[slot]) {
+			slots[numCaptured++] = slot;
+		}
+	}
+
+	if (numCaptured == 0) {
+		return false;
+	}
+
+	if (numCaptured == 1) {
+		const float weight = 1.f;
+		return blend(slots, &weight, 1, output);
+	}
+
+	// Blend the pair of neighbouring snapshots the position falls between.
+	const float scaled = juce::jlimit(0.f, 1.f, position) * (numCaptured - 1);
+	const int first = std::min((int)scaled, numCaptured - 2);
+	const float fraction = scaled - first;
+
+	const int pair[2] = { slots[first], slots[first + 1] };
+	const float weights[2] = { 1.f - fraction, fraction };
+
+	return blend(pair, weights, 2, output);
+}
+
+bool
+ParameterMorph::morphXY(float x, float y, float* output) const
+{
+	x = juce::jlimit(0.f, 1.f, x);
+	y = juce::jlimit(0.f, 1.f, y);
+
+	const float cornerWeights[4] = { (1.f - x) * (1.f - y), x * (1.f - y), (1.f - x) * y, x * y };
+
+	int slots[4];
+	float weights[4];
+	int numCorners = 0;
+
+	for (int corner = 0; corner < 4; corner++)
+	{
+		if (myHasSnapshot[corner]) {
+			slots[numCorners] = corner;
+			weights[numCorners] = cornerWeights[corner];
+			numCorners++;
+		}
+	}
+
+	return blend(slots, weights, numCorners, output);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <vector>
+
+// Snapshots of every parameter of a plugin, and blends between them.
+//
+// Each snapshot is one contiguous array, so a blend is a few vectorized passes
+// however many parameters the plugin has. Discrete parameters don't blend;
+// they take the value from whichever snapshot weighs the most.
+class ParameterMorph
+{
+public:
+	static const int kNumSnapshots = 8;
+
+	// Forgets the snapshots and sizes them for a plugin's parameters.
+	void setParameters(const std::vector<bool>& isDiscrete);
+
+	int getNumParameters() const { return myNumParameters; }
+
+	// Copies a value per parameter into a slot.
+	void capture(int slot, const float* values);
+
+	bool hasSnapshot(int slot) const { return slot >= 0 && slot < kNumSnapshots && myHasSnapshot[slot]; }
+
+	// Blends along the captured slots below numSlots, from the first at 0 to the
+	// last at 1. Returns false if none are captured.
+	bool morphLinear(float position, int numSlots, float* output) const;
+
+	// Blends slots 0 to 3, at the corners (0, 0), (1, 0), (0, 1) and (1, 1).
+	// A corner that hasn't been captured is left out. Returns false if none are.
+	bool morphXY(float x, float y, float* output) const;
+
+private:
+
+	bool blend(const int* slots, const float* weights, int numSlots, float* output) const;
+
+	const float* getSnapshot(int slot) const { return mySnapshots.data() + (size_t)slot * myNumParameters; }
+
+	std::vector<float> mySnapshots;
+	std::vector<int> myDiscreteParameters;
+	bool myHasSnapshot[kNumSnapshots] = {};
+	int myNumParameters = 0;
+};
@@ -0,0 +1,83 @@
+#include "ParameterResampler.h"
+
+#include <cmath>
+
+const OP_CHOPInput*
+ParameterResampler::process(const OP_CHOPInput* parameterCHOP, double sampleRate, int numSamples)
+{
+	using namespace juce;
+
+	if (parameterCHOP->sampleRate >= sampleRate || parameterCHOP->sampleRate <= 0. || numSamples <= 0) {
+		reset();
+		return parameterCHOP;
+	}
+
+	const int numChannels = parameterCHOP->numChannels;
+	const int numSourceSamples = parameterCHOP->numSamples;
+
+	// Audio samples from one of the CHOP's samples to the next.
+	const double step = sampleRate / parameterCHOP->sampleRate;
+
+	myBuffer.setSize(numChannels, numSamples, false, false, true);
+	myChannels.resize((size_t)numChannels);
+
+	if ((int)myLastValues.size() != numChannels) {
+		myLastValues.resize((size_t)numChannels);
+		myHasLastValues = false;
+	}
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		const float* source = parameterCHOP->getChannelData(chan);
+		float* dest = myBuffer.getWritePointer(chan);
+		myChannels[chan] = dest;
+
+		float value = myHasLastValues ? myLastValues[chan] : (numSourceSamples > 0 ? source[0] : 0.f);
+
+		// Most parameters hold still, which needs no ramp at all.
+		const auto range = numSourceSamples > 0 ? FloatVectorOperations::findMinAndMax(source, numSourceSamples) : Range<float>(value, value);
+
+		if (range.getStart() == value && range.getEnd() == value) {
+			FloatVectorOperations::fill(dest, value, numSamples);
+			myLastValues[chan] = value;
+			continue;
+		}
+
+		// Where the previous value sits, one step before the first sample. Audio
+		// samples before it hold that value.
+		double position = (numSamples - 1) - numSourceSamples * step;
+		int samp = 0;
+
+		for (int i = 0; i < numSourceSamples; i++)
+		{
+			const float target = source[i];
+			const int end = std::min(numSamples, (int)std::floor(position + step) + 1);
+
+			for (; samp < end; samp++)
+			{
+				const double amount = jlimit(0., 1., (samp - position) / step);
+				dest[samp] = value + (target - value) * (float)amount;
+			}
+
+			position += step;
+			value = target;
+		}
+
+		// Catches rounding at the end of the cook.
+		for (; samp < numSamples; samp++)
+		{
+			dest[samp] = value;
+		}
+
+		myLastValues[chan] = value;
+	}
+
+	myHasLastValues = true;
+
+	myResampledCHOP = *parameterCHOP;
+	myResampledCHOP.sampleRate = sampleRate;
+	myResampledCHOP.numSamples = numSamples;
+	myResampledCHOP.channelData = myChannels.data();
+
+	return &myResampledCHOP;
+}
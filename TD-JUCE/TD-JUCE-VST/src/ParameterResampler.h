@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CHOP_CPlusPlusBase.h"
+
+#include "JuceHeader.h"
+
+#include <vector>
+
+// Resamples a parameter CHOP that runs slower than the audio, such as one at
+// TouchDesigner's frame rate, into linear ramps at the audio rate, so the
+// parameters glide from one of its samples to the next instead of jumping once
+// a cook.
+//
+// The CHOP's samples are spaced by the ratio of the two sample rates, with the
+// last one landing on the cook's last audio sample. The ramp into the first
+// one starts from the previous cook's last value.
+class ParameterResampler
+{
+public:
+	// Returns a CHOP with numSamples samples per channel at sampleRate, valid
+	// until the next call. A CHOP that's already at least that rate is returned
+	// as it is. The storage only grows, so this doesn't allocate once the
+	// channel count and cook length have settled.
+	const OP_CHOPInput* process(const OP_CHOPInput* parameterCHOP, double sampleRate, int numSamples);
+
+	// Forgets the previous cook's values, so the next cook starts without a ramp.
+	void reset() { myHasLastValues = false; }
+
+private:
+
+	OP_CHOPInput myResampledCHOP = {};
+	juce::AudioBuffer<float> myBuffer;
+	std::vector<const float*> myChannels;
+
+	std::vector<float> myLastValues;
+	bool myHasLastValues = false;
+};
@@ -0,0 +1,122 @@
+#include "PluginCache.h"
+
+PluginCache&
+PluginCache::getInstance()
+{
+	static PluginCache instance;
+	return instance;
+}
+
+PluginCache::PluginCache()
+	: myFileLock("TD-JUCE-PluginCache")
+{
+	using namespace juce;
+
+	myFormatManager.addDefaultFormats();
+
+	myCacheFile = File::getSpecialLocation(File::userApplicationDataDirectory)
+		.getChildFile("TD-JUCE")
+		.getChildFile("PluginCache.xml");
+
+	const InterProcessLock::ScopedLockType fileLock(myFileLock);
+	load();
+}
+
+void
+PluginCache::load()
+{
+	if (!myCacheFile.existsAsFile()) {
+		return;
+	}
+
+	if (auto xml = juce::parseXML(myCacheFile)) {
+		myKnownPlugins.recreateFromXml(*xml);
+	}
+}
+
+void
+PluginCache::save()
+{
+	if (auto xml = myKnownPlugins.createXml()) {
+		myCacheFile.getParentDirectory().createDirectory();
+		xml->writeTo(myCacheFile);
+	}
+}
+
+bool
+PluginCache::findPlugins(const juce::String& path, juce::OwnedArray<juce::PluginDescription>& descriptions, bool& wasCacheHit)
+{
+	using namespace juce;
+
+	const File file(path);
+	const Time modificationTime = file.getLastModificationTime();
+
+	{
+		const ScopedLock sl(myLock);
+
+		for (auto& type : myKnownPlugins.getTypes())
+		{
+			if (File(type.fileOrIdentifier) == file && type.lastFileModTime == modificationTime) {
+				descriptions.add(new PluginDescription(type));
+			}
+		}
+	}
+
+	wasCacheHit = descriptions.size() > 0;
+
+	if (wasCacheHit) {
+		return true;
+	}
+
+	// Scanning runs unlocked, as a plugin can hang in it and the loader thread
+	// doing it may then be killed.
+	for (int i = myFormatManager.getNumFormats(); --i >= 0;)
+	{
+		auto format = myFormatManager.getFormat(i);
+
+		if (format->fileMightContainThisPluginType(path)) {
+			format->findAllTypesForFile(descriptions, path);
+		}
+	}
+
+	if (descriptions.size() == 0) {
+		return false;
+	}
+
+	const ScopedLock sl(myLock);
+	const InterProcessLock::ScopedLockType fileLock(myFileLock);
+
+	// Start from what's on disk, so entries the other CHOP DLL saved since we
+	// last read the file aren't overwritten. Everything we've added ourselves
+	// has been saved to it too.
+	load();
+
+	// Forget anything scanned from an older version of the file.
+	for (auto& type : myKnownPlugins.getTypes())
+	{
+		if (File(type.fileOrIdentifier) == file) {
+			myKnownPlugins.removeType(type);
+		}
+	}
+
+	// Key the entries on the modification time we looked up, whatever the
+	// format filled in, so the next lookup matches exactly.
+	for (auto description : descriptions)
+	{
+		description->lastFileModTime = modificationTime;
+		myKnownPlugins.addType(*description);
+	}
+
+	save();
+
+	return true;
+}
+
+std::unique_ptr<juce::AudioPluginInstance>
+PluginCache::createPluginInstance(const juce::PluginDescription& description,
+	double sampleRate, int blockSize, juce::String& errorMessage)
+{
+	// The format manager isn't modified after construction, so this doesn't need
+	// the lock, and plugins in different CHOPs can be instantiated at once.
+	return myFormatManager.createPluginInstance(description, sampleRate, blockSize, errorMessage);
+}
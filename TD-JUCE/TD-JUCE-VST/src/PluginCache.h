@@ -0,0 +1,46 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+// Process-wide plugin format manager and list of known plugins.
+//
+// Every plugin file that gets scanned is remembered, along with its
+// modification time, in an XML file in the user's application data folder.
+// Loading a file again skips the scan unless the file has changed since, so
+// switching between known plugins only costs their instantiation.
+//
+// The VST and VSTGraph CHOPs each have their own PluginCache but share the
+// file, so it's only read and written under an InterProcessLock, and each save
+// merges in what the other one has saved since.
+class PluginCache
+{
+public:
+	static PluginCache& getInstance();
+
+	// Finds the plugins in a file, from the cache if the file hasn't changed
+	// since it was last scanned. Sets wasCacheHit accordingly.
+	// Returns false if the file doesn't contain any plugins.
+	bool findPlugins(const juce::String& path, juce::OwnedArray<juce::PluginDescription>& descriptions, bool& wasCacheHit);
+
+	std::unique_ptr<juce::AudioPluginInstance> createPluginInstance(const juce::PluginDescription& description,
+		double sampleRate, int blockSize, juce::String& errorMessage);
+
+private:
+
+	PluginCache();
+
+	void load();
+	void save();
+
+	juce::CriticalSection myLock;
+
+	// Guards the cache file across DLLs and processes.
+	juce::InterProcessLock myFileLock;
+
+	juce::AudioPluginFormatManager myFormatManager;
+	juce::KnownPluginList myKnownPlugins;
+
+	juce::File myCacheFile;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PluginCache)
+};
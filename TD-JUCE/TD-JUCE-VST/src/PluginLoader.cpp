@@ -0,0 +1,554 @@
+#include "PluginLoader.h"
+
+#include "PluginCache.h"
+#include "SandboxedPlugin.h"
+
+#include <iostream>
+#include <filesystem>
+
+// How often the loader checks whether it should exit while it waits for the
+// message thread.
+static const int kMessageThreadWaitMs = 100;
+// How long the destructor waits for a load to give up before killing the thread.
+static const int kStopTimeoutMs = 2000;
+
+PluginLoader::PluginLoader() : juce::Thread("TD-JUCE-VST loader")
+{
+	startThread();
+}
+
+PluginLoader::~PluginLoader()
+{
+	// Waiting for the message thread or a sandbox helper gives up once the
+	// thread is told to exit, so this only has to kill a plugin scan that hangs.
+	// Scans run without the PluginCache locked, so that doesn't leave it locked.
+	signalThreadShouldExit();
+	notify();
+	stopThread(kStopTimeoutMs);
+}
+
+void
+PluginLoader::ensureMessageThread()
+{
+	// The message manager takes the thread that creates it as the message
+	// thread. On Windows its hidden message window is then served by the
+	// host's own message loop, so nothing here has to run one.
+	juce::MessageManager::getInstance();
+}
+
+void
+PluginLoader::loadPlugin(const std::string& pluginPath, const std::string& presetPath,
+	double sampleRate, int blockSize, juce::AudioPlayHead* playHead, int numInstances, bool sandboxed)
+{
+	{
+		const juce::ScopedLock sl(myLock);
+
+		myHasPluginRequest = true;
+		myRequestedPluginPath = pluginPath;
+		myRequestedPresetPath = presetPath;
+		myRequestedSampleRate = sampleRate;
+		myRequestedBlockSize = blockSize;
+		myRequestedPlayHead = playHead;
+		myRequestedNumInstances = numInstances;
+		myRequestedSandboxed = sandboxed;
+
+		myIsLoadingPlugin = true;
+	}
+
+	notify();
+}
+
+void
+PluginLoader::loadPreset(const std::string& presetPath)
+{
+	{
+		const juce::ScopedLock sl(myLock);
+
+		myHasPresetRequest = true;
+		myRequestedPresetFile = presetPath;
+	}
+
+	notify();
+}
+
+void
+PluginLoader::loadPresetBank(const std::vector<std::string>& paths)
+{
+	{
+		const juce::ScopedLock sl(myLock);
+
+		myHasPresetBankRequest = true;
+		myRequestedPresetBank = paths;
+	}
+
+	notify();
+}
+
+std::unique_ptr<PluginRenderer>
+PluginLoader::takeLoadedRenderer(std::string& errorMessage,
+	std::vector<std::unique_ptr<PluginRenderer>>* extraInstances)
+{
+	if (!myHasLoadedRenderer) {
+		return nullptr;
+	}
+
+	std::unique_ptr<PluginRenderer> renderer;
+	std::vector<std::unique_ptr<PluginRenderer>> instances;
+
+	{
+		const juce::ScopedLock sl(myLock);
+
+		myHasLoadedRenderer = false;
+		errorMessage = myLoadError;
+
+		renderer = std::move(myLoadedRenderer);
+		instances.swap(myLoadedInstances);
+	}
+
+	if (extraInstances) {
+		extraInstances->swap(instances);
+	}
+
+	for (auto& instance : instances)
+	{
+		retire(std::move(instance));
+	}
+
+	return renderer;
+}
+
+bool
+PluginLoader::takeLoadedPreset(juce::MemoryBlock& presetData)
+{
+	if (!myHasLoadedPreset) {
+		return false;
+	}
+
+	const juce::ScopedLock sl(myLock);
+
+	myHasLoadedPreset = false;
+	presetData = std::move(myLoadedPreset);
+
+	return true;
+}
+
+bool
+PluginLoader::takeLoadedPresetBank(std::vector<juce::MemoryBlock>& presets)
+{
+	if (!myHasLoadedPresetBank) {
+		return false;
+	}
+
+	const juce::ScopedLock sl(myLock);
+
+	myHasLoadedPresetBank = false;
+	presets.swap(myLoadedPresetBank);
+
+	return true;
+}
+
+void
+PluginLoader::retire(std::unique_ptr<PluginRenderer> renderer)
+{
+	if (!renderer) {
+		return;
+	}
+
+	auto plugin = renderer->getPlugin();
+
+	if (plugin && dynamic_cast<SandboxedPlugin*>(plugin) == nullptr) {
+		const juce::ScopedLock sl(myLock);
+		myRetiredOnMessageThread.push_back(std::move(renderer));
+		return;
+	}
+
+	{
+		const juce::ScopedLock sl(myLock);
+		myRetiredRenderers.push_back(std::move(renderer));
+	}
+
+	notify();
+}
+
+void
+PluginLoader::retire(std::unique_ptr<PluginLoader> loader)
+{
+	if (!loader) {
+		return;
+	}
+
+	{
+		const juce::ScopedLock sl(myLock);
+		myRetiredLoaders.push_back(std::move(loader));
+	}
+
+	notify();
+}
+
+void
+PluginLoader::destroyRetired()
+{
+	std::vector<std::unique_ptr<PluginRenderer>> retiredRenderers;
+
+	{
+		const juce::ScopedLock sl(myLock);
+		retiredRenderers.swap(myRetiredOnMessageThread);
+	}
+}
+
+bool
+PluginLoader::readPresetFile(const std::string& path, juce::MemoryBlock& presetData)
+{
+	using namespace juce;
+
+	if (path.empty() || !std::filesystem::exists(path)) {
+		return false;
+	}
+
+	return File(path).loadFileAsData(presetData);
+}
+
+void
+PluginLoader::readPresetBank(const std::vector<std::string>& paths, std::vector<juce::MemoryBlock>& presets)
+{
+	using namespace juce;
+
+	presets.clear();
+
+	for (const auto& path : paths)
+	{
+		if (path.empty()) {
+			continue;
+		}
+
+		const File file(path);
+
+		if (!file.isDirectory()) {
+			presets.emplace_back();
+			readPresetFile(path, presets.back());
+			continue;
+		}
+
+		auto files = file.findChildFiles(File::findFiles, false, "*.fxp;*.fxb;*.vstpreset");
+		files.sort();
+
+		for (const auto& child : files)
+		{
+			presets.emplace_back();
+			child.loadFileAsData(presets.back());
+		}
+	}
+}
+
+// Returns true if the preset was loaded successfully. False otherwise.
+bool
+PluginLoader::applyPreset(juce::AudioPluginInstance* plugin, const juce::MemoryBlock& presetData)
+{
+	using namespace juce;
+
+	// The helper process applies it to the real plugin.
+	if (auto sandboxedPlugin = dynamic_cast<SandboxedPlugin*>(plugin)) {
+		return sandboxedPlugin->applyPreset(presetData);
+	}
+
+	try {
+#if JUCE_PLUGINHOST_VST
+		// The VST2 way of loading preset. You need the entire VST2 SDK source, which is not public.
+		VSTPluginFormat::loadFromFXBFile(plugin, presetData.getData(), presetData.getSize());
+
+#else
+
+		setVST3PluginStateDirect(plugin, presetData);
+
+#endif
+
+		return true;
+	}
+	catch (std::exception& e) {
+		std::cout << "PluginLoader::applyPreset " << e.what() << std::endl;
+		return false;
+	}
+}
+
+std::unique_ptr<juce::PluginDescription>
+PluginLoader::findPlugin(const std::string& pluginPath, std::string& errorMessage)
+{
+	using namespace juce;
+
+	if (!std::filesystem::exists(pluginPath)) {
+		errorMessage = "VST file not found: " + pluginPath;
+		return nullptr;
+	}
+
+	juce::OwnedArray<PluginDescription> pluginDescriptions;
+	bool wasCacheHit = false;
+
+	const bool foundPlugins = PluginCache::getInstance().findPlugins(String(pluginPath), pluginDescriptions, wasCacheHit);
+
+	if (wasCacheHit) {
+		myCacheHits++;
+	}
+	else {
+		myCacheMisses++;
+	}
+
+	if (!foundPlugins) {
+		// If there is a problem here first check the preprocessor definitions
+		// in the projucer are sensible - is it set up to scan for plugin's?
+		errorMessage = "No plugin found in " + pluginPath;
+		return nullptr;
+	}
+
+	return std::make_unique<PluginDescription>(*pluginDescriptions[0]);
+}
+
+std::unique_ptr<PluginRenderer>
+PluginLoader::createRenderer(const juce::PluginDescription& description,
+	const juce::MemoryBlock& presetData, double sampleRate, int blockSize, juce::AudioPlayHead* playHead,
+	std::string& errorMessage)
+{
+	using namespace juce;
+
+	auto renderer = std::make_unique<PluginRenderer>();
+
+	String error;
+
+	auto plugin = createPluginOnMessageThread(description, sampleRate, blockSize, error);
+
+	if (plugin == nullptr)
+	{
+		errorMessage = error.toStdString();
+		std::cout << "PluginLoader::createRenderer error: " << errorMessage << std::endl;
+		return renderer;
+	}
+
+	plugin->setPlayHead(playHead);
+	plugin->setNonRealtime(false);  // The CHOP switches this on for offline renders.
+
+	renderer->setPlugin(std::move(plugin));
+	renderer->prepare(sampleRate, blockSize);
+
+	if (presetData.getSize() > 0) {
+		applyPreset(renderer->getPlugin(), presetData);
+	}
+
+	errorMessage.clear();
+	return renderer;
+}
+
+// Shared with the message thread, which may only get to it after the loader
+// has given up.
+struct PluginCreation
+{
+	juce::CriticalSection lock;
+	juce::WaitableEvent isDone;
+	bool isAbandoned = false;
+	std::unique_ptr<juce::AudioPluginInstance> plugin;
+	juce::String errorMessage;
+};
+
+std::unique_ptr<juce::AudioPluginInstance>
+PluginLoader::createPluginOnMessageThread(const juce::PluginDescription& description,
+	double sampleRate, int blockSize, juce::String& errorMessage)
+{
+	using namespace juce;
+
+	auto creation = std::make_shared<PluginCreation>();
+
+	const bool isPosted = MessageManager::callAsync([creation, description, sampleRate, blockSize] {
+		const ScopedLock sl(creation->lock);
+
+		if (!creation->isAbandoned) {
+			creation->plugin = PluginCache::getInstance().createPluginInstance(description, sampleRate, blockSize, creation->errorMessage);
+			creation->isDone.signal();
+		}
+	});
+
+	if (!isPosted) {
+		errorMessage = "There's no message thread to create the plugin on";
+		return nullptr;
+	}
+
+	while (!creation->isDone.wait(kMessageThreadWaitMs))
+	{
+		if (Thread::currentThreadShouldExit()) {
+			break;
+		}
+	}
+
+	// A plugin that was created after all is still taken, so it's destroyed on
+	// the message thread along with the loader's other results.
+	const ScopedLock sl(creation->lock);
+
+	creation->isAbandoned = true;
+	errorMessage = creation->errorMessage;
+
+	if (!creation->plugin && errorMessage.isEmpty()) {
+		errorMessage = "The plugin load was cancelled";
+	}
+
+	return std::move(creation->plugin);
+}
+
+std::unique_ptr<PluginRenderer>
+PluginLoader::createSandboxedRenderer(const std::string& pluginPath, const std::string& presetPath,
+	double sampleRate, int blockSize, juce::AudioPlayHead* playHead, std::string& errorMessage)
+{
+	auto renderer = std::make_unique<PluginRenderer>();
+
+	if (!std::filesystem::exists(pluginPath)) {
+		errorMessage = "VST file not found: " + pluginPath;
+		return renderer;
+	}
+
+	// The helper scans the plugin and applies the preset itself.
+	auto plugin = SandboxedPlugin::create(pluginPath, presetPath, sampleRate, blockSize, errorMessage);
+
+	if (plugin) {
+		plugin->setPlayHead(playHead);
+		renderer->setPlugin(std::move(plugin));
+		renderer->prepare(sampleRate, blockSize);
+		errorMessage.clear();
+	}
+
+	return renderer;
+}
+
+void
+PluginLoader::run()
+{
+	while (!threadShouldExit())
+	{
+		std::vector<std::unique_ptr<PluginRenderer>> retiredRenderers;
+		std::vector<std::unique_ptr<PluginLoader>> retiredLoaders;
+
+		bool hasPluginRequest;
+		std::string pluginPath, presetPath;
+		double sampleRate;
+		int blockSize;
+		juce::AudioPlayHead* playHead;
+		int numInstances;
+		bool sandboxed;
+
+		bool hasPresetRequest;
+		std::string presetFile;
+
+		bool hasPresetBankRequest;
+		std::vector<std::string> presetBank;
+
+		{
+			const juce::ScopedLock sl(myLock);
+
+			retiredRenderers.swap(myRetiredRenderers);
+			retiredLoaders.swap(myRetiredLoaders);
+
+			hasPluginRequest = myHasPluginRequest;
+			pluginPath = myRequestedPluginPath;
+			presetPath = myRequestedPresetPath;
+			sampleRate = myRequestedSampleRate;
+			blockSize = myRequestedBlockSize;
+			playHead = myRequestedPlayHead;
+			numInstances = myRequestedNumInstances;
+			sandboxed = myRequestedSandboxed;
+			myHasPluginRequest = false;
+
+			hasPresetRequest = myHasPresetRequest;
+			presetFile = myRequestedPresetFile;
+			myHasPresetRequest = false;
+
+			hasPresetBankRequest = myHasPresetBankRequest;
+			presetBank.swap(myRequestedPresetBank);
+			myHasPresetBankRequest = false;
+		}
+
+		// Releasing a sandboxed plugin waits for its helper to quit, and a loader for its thread.
+		retiredRenderers.clear();
+		retiredLoaders.clear();
+
+		if (hasPresetRequest) {
+			juce::MemoryBlock presetData;
+
+			if (readPresetFile(presetFile, presetData)) {
+				const juce::ScopedLock sl(myLock);
+				myLoadedPreset = std::move(presetData);
+				myHasLoadedPreset = true;
+			}
+		}
+
+		if (hasPresetBankRequest) {
+			std::vector<juce::MemoryBlock> presets;
+			readPresetBank(presetBank, presets);
+
+			const juce::ScopedLock sl(myLock);
+			myLoadedPresetBank.swap(presets);
+			myHasLoadedPresetBank = true;
+		}
+
+		if (hasPluginRequest) {
+			std::string errorMessage;
+			std::unique_ptr<PluginRenderer> renderer;
+			std::vector<std::unique_ptr<PluginRenderer>> instances;
+
+			if (sandboxed) {
+				renderer = createSandboxedRenderer(pluginPath, presetPath, sampleRate, blockSize, playHead, errorMessage);
+
+				for (int i = 1; i < numInstances && renderer->getPlugin() && !threadShouldExit(); i++)
+				{
+					std::string instanceError;
+					instances.push_back(createSandboxedRenderer(pluginPath, presetPath, sampleRate, blockSize, playHead, instanceError));
+				}
+			}
+			else {
+				auto description = findPlugin(pluginPath, errorMessage);
+
+				if (description) {
+					juce::MemoryBlock presetData;
+					readPresetFile(presetPath, presetData);
+
+					renderer = createRenderer(*description, presetData, sampleRate, blockSize, playHead, errorMessage);
+
+					for (int i = 1; i < numInstances && renderer->getPlugin() && !threadShouldExit(); i++)
+					{
+						std::string instanceError;
+						instances.push_back(createRenderer(*description, presetData, sampleRate, blockSize, playHead, instanceError));
+					}
+				}
+				else {
+					renderer = std::make_unique<PluginRenderer>();
+				}
+			}
+
+			const juce::ScopedLock sl(myLock);
+
+			if (myHasPluginRequest) {
+				// A newer request came in while this one was loading.
+				retire(std::move(renderer));
+
+				for (auto& instance : instances)
+				{
+					retire(std::move(instance));
+				}
+			}
+			else {
+				// Replace a result that was never taken.
+				retire(std::move(myLoadedRenderer));
+
+				for (auto& instance : myLoadedInstances)
+				{
+					retire(std::move(instance));
+				}
+
+				myLoadedRenderer = std::move(renderer);
+				myLoadedInstances = std::move(instances);
+				myLoadError = errorMessage;
+				myHasLoadedRenderer = true;
+				myIsLoadingPlugin = false;
+			}
+
+			// Go round again to pick up whatever arrived in the meantime.
+			continue;
+		}
+
+		wait(-1);
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "PluginRenderer.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Scans, instantiates and prepares plugins and reads presets on a background
+// thread so the cook thread never waits on a file scan, disk I/O or a plugin
+// getting ready.
+//
+// Many plugins, and JUCE's VST3 host, expect their constructor and destructor
+// to run on JUCE's message thread, which is TouchDesigner's main thread (see
+// ensureMessageThread()). So the loader thread posts only the constructor
+// there, between cooks, and prepares the plugin and applies its preset itself.
+// Plugins are destroyed by destroyRetired(). A sandboxed plugin is only a proxy
+// for a helper process, so it's created and destroyed on the loader thread.
+class PluginLoader : private juce::Thread
+{
+public:
+	PluginLoader();
+	~PluginLoader();
+
+	// Starts loading a plugin, replacing any request that hasn't started yet.
+	// If presetPath isn't empty the preset is applied before the handover.
+	// With more than one instance, each gets its own renderer. A sandboxed
+	// plugin runs in a helper process behind a SandboxedPlugin.
+	void loadPlugin(const std::string& pluginPath, const std::string& presetPath,
+		double sampleRate, int blockSize, juce::AudioPlayHead* playHead, int numInstances = 1, bool sandboxed = false);
+
+	// Starts reading a preset file, to be applied by the caller to the
+	// plugin it's rendering.
+	void loadPreset(const std::string& presetPath);
+
+	// Starts reading a bank of presets into memory. A path that's a folder
+	// stands for the preset files in it, in name order.
+	void loadPresetBank(const std::vector<std::string>& paths);
+
+	// True from loadPlugin() until its renderer is ready to be taken.
+	bool isLoadingPlugin() const { return myIsLoadingPlugin; }
+
+	// Returns the prepared renderer from the last finished load, if there is
+	// one, without blocking. It may hold no plugin if the load failed, in which
+	// case errorMessage says why. The renderers of any other instances are moved
+	// into extraInstances, or retired if it's nullptr.
+	std::unique_ptr<PluginRenderer> takeLoadedRenderer(std::string& errorMessage,
+		std::vector<std::unique_ptr<PluginRenderer>>* extraInstances = nullptr);
+
+	// Moves the last preset that was read into presetData, without blocking.
+	// Returns false if there isn't one.
+	bool takeLoadedPreset(juce::MemoryBlock& presetData);
+
+	// True if a bank has been read since the last takeLoadedPresetBank().
+	bool hasLoadedPresetBank() const { return myHasLoadedPresetBank; }
+
+	// Swaps the last bank that was read into presets, without blocking.
+	// Returns false if there isn't one.
+	bool takeLoadedPresetBank(std::vector<juce::MemoryBlock>& presets);
+
+	// How many plugin loads found the file in the PluginCache, and how many had to scan it.
+	int32_t getCacheHits() const { return myCacheHits; }
+	int32_t getCacheMisses() const { return myCacheMisses; }
+
+	// Hands over a renderer to be released and destroyed later, from any thread.
+	// A sandboxed one is destroyed on the loader thread, any other one by the
+	// next destroyRetired().
+	void retire(std::unique_ptr<PluginRenderer> renderer);
+
+	// Hands over another loader to be destroyed on the loader thread, which
+	// waits for it to finish whatever it's loading. Its retired renderers
+	// should be destroyed first.
+	void retire(std::unique_ptr<PluginLoader> loader);
+
+	// Destroys the retired renderers whose plugins have to go on the message
+	// thread. Called by the cook thread once a cook.
+	void destroyRetired();
+
+	// Makes the calling thread JUCE's message thread, unless there already is
+	// one. Called from the constructor of every CHOP that hosts plugins, which
+	// runs on TouchDesigner's main thread.
+	static void ensureMessageThread();
+
+	// Applies FXP or VST3 preset data to a plugin. Returns true on success.
+	static bool applyPreset(juce::AudioPluginInstance* plugin, const juce::MemoryBlock& presetData);
+
+	// Reads a preset file. Returns false if it doesn't exist or can't be read.
+	static bool readPresetFile(const std::string& path, juce::MemoryBlock& presetData);
+
+	// Reads each path's presets, or an empty preset where a file can't be read
+	// so that indices still line up with the list.
+	static void readPresetBank(const std::vector<std::string>& paths, std::vector<juce::MemoryBlock>& presets);
+
+	// Runs the plugin's constructor on the message thread and waits for it.
+	// Gives up, returning nullptr, if the calling thread is told to exit first.
+	static std::unique_ptr<juce::AudioPluginInstance> createPluginOnMessageThread(const juce::PluginDescription& description,
+		double sampleRate, int blockSize, juce::String& errorMessage);
+
+private:
+
+	void run() override;
+
+	// Finds the plugin in the PluginCache, scanning it if it isn't there yet.
+	std::unique_ptr<juce::PluginDescription> findPlugin(const std::string& pluginPath, std::string& errorMessage);
+
+	// Creates a renderer and prepares its plugin, with the preset applied.
+	static std::unique_ptr<PluginRenderer> createRenderer(const juce::PluginDescription& description,
+		const juce::MemoryBlock& presetData, double sampleRate, int blockSize, juce::AudioPlayHead* playHead,
+		std::string& errorMessage);
+
+	static std::unique_ptr<PluginRenderer> createSandboxedRenderer(const std::string& pluginPath, const std::string& presetPath,
+		double sampleRate, int blockSize, juce::AudioPlayHead* playHead, std::string& errorMessage);
+
+	juce::CriticalSection myLock;
+
+	// Requests, written by the cook thread. Guarded by myLock.
+	bool myHasPluginRequest = false;
+	std::string myRequestedPluginPath;
+	std::string myRequestedPresetPath;
+	double myRequestedSampleRate = 0.;
+	int myRequestedBlockSize = 0;
+	juce::AudioPlayHead* myRequestedPlayHead = nullptr;
+	int myRequestedNumInstances = 1;
+	bool myRequestedSandboxed = false;
+
+	bool myHasPresetRequest = false;
+	std::string myRequestedPresetFile;
+
+	bool myHasPresetBankRequest = false;
+	std::vector<std::string> myRequestedPresetBank;
+
+	std::vector<std::unique_ptr<PluginRenderer>> myRetiredRenderers;
+	std::vector<std::unique_ptr<PluginRenderer>> myRetiredOnMessageThread;
+	std::vector<std::unique_ptr<PluginLoader>> myRetiredLoaders;
+
+	// Results, written by the loader thread. Guarded by myLock, with the atomics
+	// letting the cook thread check for them without taking the lock.
+	std::unique_ptr<PluginRenderer> myLoadedRenderer;
+	std::vector<std::unique_ptr<PluginRenderer>> myLoadedInstances;
+	std::string myLoadError;
+	std::atomic<bool> myHasLoadedRenderer { false };
+
+	juce::MemoryBlock myLoadedPreset;
+	std::atomic<bool> myHasLoadedPreset { false };
+
+	// Also holds the bank the cook thread swapped out, so it's freed here.
+	std::vector<juce::MemoryBlock> myLoadedPresetBank;
+	std::atomic<bool> myHasLoadedPresetBank { false };
+
+	std::atomic<bool> myIsLoadingPlugin { false };
+
+	std::atomic<int32_t> myCacheHits { 0 };
+	std::atomic<int32_t> myCacheMisses { 0 };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PluginLoader)
+};
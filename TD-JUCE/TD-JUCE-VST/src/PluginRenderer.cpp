@@ -0,0 +1,340 @@
+#include "PluginRenderer.h"
+
+#include <cmath>
+#include <limits>
+
+// Room for this many MIDI events per block before the MidiBuffer has to grow.
+// Each event takes its timestamp, size and up to 3 bytes of message data.
+static const size_t kReservedMidiEvents = 2048;
+static const size_t kBytesPerMidiEvent = sizeof(int32_t) + sizeof(uint16_t) + 3;
+
+PluginRenderer::PluginRenderer()
+{
+	myMidiBuffer.ensureSize(kReservedMidiEvents * kBytesPerMidiEvent);
+	myOversampledMidiBuffer.ensureSize(kReservedMidiEvents * kBytesPerMidiEvent);
+}
+
+PluginRenderer::~PluginRenderer()
+{
+	setPlugin(nullptr);
+}
+
+void
+PluginRenderer::setPlugin(std::unique_ptr<juce::AudioPluginInstance> plugin)
+{
+	if (myPlugin) {
+		myPlugin->setPlayHead(nullptr);
+		myPlugin->releaseResources();
+	}
+
+	myPlugin = std::move(plugin);
+
+	const size_t numParameters = myPlugin ? (size_t)myPlugin->getNumParameters() : 0;
+	myPendingParameterValues.assign(numParameters, 0.f);
+	myLastParameterValues.assign(numParameters, 0.f);
+	myParameterDeltas.assign(numParameters, 0.f);
+	invalidateParameterCache();
+
+	// The new plugin starts out with its default buses.
+	myHasBusLayout = false;
+	myIsBusLayoutRejected = false;
+
+	// Force the next prepare() to prepare the new instance.
+	myPreparedSampleRate = 0.;
+	myMaximumBlockSize = 0;
+}
+
+bool
+PluginRenderer::needsPrepare(double sampleRate, int maximumBlockSize) const
+{
+	if (!myPlugin || sampleRate <= 0. || maximumBlockSize <= 0) {
+		return false;
+	}
+
+	return sampleRate != myPreparedSampleRate ||
+		maximumBlockSize != myMaximumBlockSize ||
+		myOversamplingLog2 != myPreparedOversamplingLog2 ||
+		(myOversamplingLog2 > 0 && myOversamplingFilter != myPreparedOversamplingFilter) ||
+		myPlugin->getTotalNumInputChannels() != myNumInputChannels ||
+		myPlugin->getTotalNumOutputChannels() != myNumOutputChannels ||
+		myPlugin->isNonRealtime() != myPreparedNonRealtime;
+}
+
+bool
+PluginRenderer::prepare(double sampleRate, int maximumBlockSize)
+{
+	if (!needsPrepare(sampleRate, maximumBlockSize)) {
+		return false;
+	}
+
+	const int numInputChannels = myPlugin->getTotalNumInputChannels();
+	const int numOutputChannels = myPlugin->getTotalNumOutputChannels();
+
+	// The buffer is processed in place, so it needs every input and output channel.
+	// Keep at least stereo because that's what the CHOP reads and writes.
+	const int numChannels = std::max(2, std::max(numInputChannels, numOutputChannels));
+	myBuffer.setSize(numChannels, maximumBlockSize, false, true, true);
+
+	int factor = 1;
+
+	if (myOversamplingLog2 > 0) {
+		// Maximum quality filters, with fractional latency.
+		myOversampling = std::make_unique<juce::dsp::Oversampling<float>>((size_t)numChannels, (size_t)myOversamplingLog2, myOversamplingFilter, true, false);
+		myOversampling->initProcessing((size_t)maximumBlockSize);
+		myOversampledChannels.resize(numChannels);
+		factor = 1 << myOversamplingLog2;
+	}
+	else {
+		myOversampling.reset();
+	}
+
+	myPlugin->prepareToPlay(sampleRate * factor, maximumBlockSize * factor);
+
+	myPreparedSampleRate = sampleRate;
+	myMaximumBlockSize = maximumBlockSize;
+	myNumInputChannels = numInputChannels;
+	myNumOutputChannels = numOutputChannels;
+	myPreparedOversamplingLog2 = myOversamplingLog2;
+	myPreparedOversamplingFilter = myOversamplingFilter;
+	myPreparedNonRealtime = myPlugin->isNonRealtime();
+	myPrepareCount++;
+
+	return true;
+}
+
+juce::AudioBuffer<float>&
+PluginRenderer::getBlockBuffer(int numSamples)
+{
+	jassert(numSamples <= myMaximumBlockSize);
+
+	// This only swaps channel pointers; up to 32 channels it doesn't allocate.
+	myBlockBuffer.setDataToReferTo(myBuffer.getArrayOfWritePointers(), myBuffer.getNumChannels(), numSamples);
+	return myBlockBuffer;
+}
+
+juce::AudioBuffer<float>&
+PluginRenderer::getBlockBuffer(float** channels, int numChannels, int numSamples)
+{
+	jassert(numChannels >= myBuffer.getNumChannels());
+	jassert(numSamples <= myMaximumBlockSize);
+
+	myBlockBuffer.setDataToReferTo(channels, numChannels, numSamples);
+	return myBlockBuffer;
+}
+
+bool
+PluginRenderer::hasBusLayout(bool allBuses, int mainBusChannels) const
+{
+	return !myPlugin || (myHasBusLayout && allBuses == myAllBuses && mainBusChannels == myMainBusChannels);
+}
+
+bool
+PluginRenderer::setBusLayout(bool allBuses, int mainBusChannels)
+{
+	if (hasBusLayout(allBuses, mainBusChannels)) {
+		return false;
+	}
+
+	myHasBusLayout = true;
+	myAllBuses = allBuses;
+	myMainBusChannels = mainBusChannels;
+
+	// Buses can only change while the plugin isn't prepared.
+	if (isPrepared()) {
+		myPlugin->releaseResources();
+		myPreparedSampleRate = 0.;
+		myMaximumBlockSize = 0;
+	}
+
+	bool isAccepted = allBuses ? myPlugin->enableAllBuses() : myPlugin->disableNonMainBuses();
+
+	for (const bool isInput : { true, false })
+	{
+		if (auto bus = myPlugin->getBus(isInput, 0)) {
+			if (mainBusChannels > 0) {
+				isAccepted &= bus->setNumberOfChannels(mainBusChannels);
+			}
+			else {
+				isAccepted &= bus->setCurrentLayout(bus->getDefaultLayout());
+			}
+		}
+	}
+
+	myIsBusLayoutRejected = !isAccepted;
+
+	return true;
+}
+
+void
+PluginRenderer::setOversampling(int factorLog2, juce::dsp::Oversampling<float>::FilterType filterType)
+{
+	myOversamplingLog2 = factorLog2;
+	myOversamplingFilter = filterType;
+}
+
+int
+PluginRenderer::getLatencySamples() const
+{
+	if (!myPlugin || !isPrepared()) {
+		return 0;
+	}
+
+	return juce::roundToInt((float)myPlugin->getLatencySamples() / getOversamplingFactor() + getOversamplingLatency());
+}
+
+void
+PluginRenderer::process(juce::AudioBuffer<float>& buffer)
+{
+	if (!myTimings) {
+		renderBlock(buffer);
+		return;
+	}
+
+	const int64_t startTicks = TimingHistogram::getTicks();
+
+	renderBlock(buffer);
+
+	const int64_t nanoseconds = TimingHistogram::ticksToNanoseconds(TimingHistogram::getTicks() - startTicks);
+	myTimings->processBlock.record(nanoseconds);
+
+	// The block missed its deadline if it took longer to render than to play.
+	if ((double)nanoseconds > 1.0e9 * buffer.getNumSamples() / myPreparedSampleRate) {
+		myTimings->deadlineMisses++;
+	}
+}
+
+void
+PluginRenderer::renderBlock(juce::AudioBuffer<float>& buffer)
+{
+	using namespace juce;
+
+	if (!myOversampling) {
+		myPlugin->processBlock(buffer, myMidiBuffer);
+		return;
+	}
+
+	// An in-place buffer can have more channels than the filters were made for.
+	auto block = dsp::AudioBlock<float>(buffer).getSubsetChannelBlock(0, (size_t)myBuffer.getNumChannels());
+	auto oversampledBlock = myOversampling->processSamplesUp(block);
+
+	for (int chan = 0; chan < (int)myOversampledChannels.size(); chan++)
+	{
+		myOversampledChannels[chan] = oversampledBlock.getChannelPointer((size_t)chan);
+	}
+
+	myOversampledBuffer.setDataToReferTo(myOversampledChannels.data(), (int)myOversampledChannels.size(), (int)oversampledBlock.getNumSamples());
+
+	const int factor = getOversamplingFactor();
+
+	myOversampledMidiBuffer.clear();
+	for (const auto metadata : myMidiBuffer)
+	{
+		myOversampledMidiBuffer.addEvent(metadata.data, metadata.numBytes, metadata.samplePosition * factor);
+	}
+
+	myPlugin->processBlock(myOversampledBuffer, myOversampledMidiBuffer);
+
+	myOversampling->processSamplesDown(block);
+}
+
+void
+PluginRenderer::reset()
+{
+	if (myPlugin) {
+		myPlugin->reset();
+	}
+
+	if (myOversampling) {
+		myOversampling->reset();
+	}
+}
+
+void
+PluginRenderer::invalidateParameterCache()
+{
+	// NaN never equals a pending value, so every parameter is sent once more.
+	std::fill(myLastParameterValues.begin(), myLastParameterValues.end(), std::numeric_limits<float>::quiet_NaN());
+	myFirstSentParameter = 0;
+	myEndSentParameter = 0;
+}
+
+int
+PluginRenderer::pushParameters(int numValues, int firstValue)
+{
+	if (!myTimings) {
+		return sendParameters(numValues, firstValue);
+	}
+
+	const int64_t startTicks = TimingHistogram::getTicks();
+
+	const int numPushed = sendParameters(numValues, firstValue);
+
+	myTimings->parameterPush.record(TimingHistogram::ticksToNanoseconds(TimingHistogram::getTicks() - startTicks));
+
+	return numPushed;
+}
+
+int
+PluginRenderer::sendParameters(int numValues, int firstValue)
+{
+	using namespace juce;
+
+	numValues = std::min(numValues, getNumParameters() - firstValue);
+
+	if (numValues <= 0 || firstValue < 0) {
+		return 0;
+	}
+
+	const float* pending = myPendingParameterValues.data() + firstValue;
+	float* last = myLastParameterValues.data() + firstValue;
+
+	int numPushed = 0;
+
+	const int endValue = firstValue + numValues;
+
+	// A NaN from the CHOP never equals the last value either, so it's never
+	// sent rather than sent every block.
+	if (firstValue < myFirstSentParameter || endValue > myEndSentParameter) {
+		for (int i = 0; i < numValues; i++)
+		{
+			if (pending[i] != last[i] && !std::isnan(pending[i])) {
+				myPlugin->setParameter(firstValue + i, pending[i]);
+				last[i] = pending[i];
+				numPushed++;
+			}
+		}
+
+		// Every value in the range has been sent now, so grow the sent range to
+		// take it in where they meet.
+		if (myFirstSentParameter == myEndSentParameter) {
+			myFirstSentParameter = firstValue;
+			myEndSentParameter = endValue;
+		}
+		else if (firstValue <= myEndSentParameter && endValue >= myFirstSentParameter) {
+			myFirstSentParameter = std::min(myFirstSentParameter, firstValue);
+			myEndSentParameter = std::max(myEndSentParameter, endValue);
+		}
+
+		return numPushed;
+	}
+
+	// Usually nothing has moved, which one vectorized pass over the deltas can tell us.
+	float* deltas = myParameterDeltas.data();
+	FloatVectorOperations::subtract(deltas, pending, last, numValues);
+
+	auto range = FloatVectorOperations::findMinAndMax(deltas, numValues);
+	if (range.getStart() == 0.f && range.getEnd() == 0.f) {
+		return 0;
+	}
+
+	for (int i = 0; i < numValues; i++)
+	{
+		if (deltas[i] != 0.f && !std::isnan(pending[i])) {
+			myPlugin->setParameter(firstValue + i, pending[i]);
+			last[i] = pending[i];
+			numPushed++;
+		}
+	}
+
+	return numPushed;
+}
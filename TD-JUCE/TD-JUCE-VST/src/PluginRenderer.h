@@ -0,0 +1,157 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "TimingHistogram.h"
+
+// Owns a hosted plugin instance and the buffers needed to render it.
+//
+// The plugin is prepared once for a maximum block size, and is only prepared
+// again when the sample rate, the maximum block size, the bus layout or its
+// non-realtime flag changes (VST3 plugins only read the flag when prepared).
+// Blocks of any length up to the maximum are then rendered out of preallocated
+// storage, so nothing on the render path allocates.
+//
+// The plugin can be oversampled, in which case it's prepared for the higher
+// rate and every block is upsampled before it and downsampled after it.
+class PluginRenderer
+{
+public:
+	PluginRenderer();
+	~PluginRenderer();
+
+	// Takes ownership of a new plugin (or nullptr), releasing the old one.
+	void setPlugin(std::unique_ptr<juce::AudioPluginInstance> plugin);
+
+	juce::AudioPluginInstance* getPlugin() const { return myPlugin.get(); }
+
+	// Prepares the plugin if anything it was prepared for has changed.
+	// Returns true if prepareToPlay() was called.
+	bool prepare(double sampleRate, int maximumBlockSize);
+
+	// True if prepare() would call prepareToPlay().
+	bool needsPrepare(double sampleRate, int maximumBlockSize) const;
+
+	// Runs the plugin at 2^factorLog2 times the sample rate, or at the sample
+	// rate when factorLog2 is 0. Takes effect at the next prepare().
+	void setOversampling(int factorLog2, juce::dsp::Oversampling<float>::FilterType filterType);
+
+	int getOversamplingFactor() const { return 1 << myPreparedOversamplingLog2; }
+
+	// Enables the plugin's sidechain and auxiliary buses along with its main
+	// ones, and asks for mainBusChannels on the main input and output buses, or
+	// their default layouts when it's 0. Plugins that can't take a layout keep
+	// the one they had. Returns true if the layout was changed, in which case
+	// the plugin is released and gets prepared again at the next prepare(), so
+	// it mustn't be rendering.
+	bool setBusLayout(bool allBuses, int mainBusChannels);
+
+	// True if setBusLayout() would have nothing to do.
+	bool hasBusLayout(bool allBuses, int mainBusChannels) const;
+
+	// True if the plugin turned down any part of the last setBusLayout().
+	bool isBusLayoutRejected() const { return myIsBusLayoutRejected; }
+
+	// The delay the oversampling filters add, in samples at the base rate.
+	float getOversamplingLatency() const { return myOversampling ? myOversampling->getLatencyInSamples() : 0.f; }
+
+	// The plugin's reported latency plus the oversampling filters', in samples at
+	// the base rate. Plugins can change their latency at any time.
+	int getLatencySamples() const;
+
+	bool isPrepared() const { return myMaximumBlockSize > 0; }
+
+	// Returns a buffer of numSamples that refers to the preallocated storage.
+	// numSamples must not exceed the prepared maximum block size.
+	juce::AudioBuffer<float>& getBlockBuffer(int numSamples);
+
+	// Returns a buffer of numSamples that refers to someone else's channel memory,
+	// such as the CHOP output, so that the plugin processes it in place.
+	// There must be at least getNumBufferChannels() channels.
+	juce::AudioBuffer<float>& getBlockBuffer(float** channels, int numChannels, int numSamples);
+
+	// The MIDI buffer handed to the plugin. Its storage is reserved up front.
+	juce::MidiBuffer& getMidiBuffer() { return myMidiBuffer; }
+
+	void process(juce::AudioBuffer<float>& buffer);
+
+	// Clears the plugin's state, and the oversampling filters' along with it.
+	void reset();
+
+	// Staging area for the next block's parameter values, one per plugin parameter.
+	float* getPendingParameterValues() { return myPendingParameterValues.data(); }
+	int getNumParameters() const { return (int)myPendingParameterValues.size(); }
+
+	// Sends numValues pending values, from firstValue, to the plugin, skipping
+	// any that equal the value last sent. Returns how many were sent.
+	int pushParameters(int numValues, int firstValue = 0);
+
+	// Makes pushParameters() send every value again, e.g. after a preset load
+	// changed the plugin's parameters behind our back.
+	void invalidateParameterCache();
+
+	// Records how long each block and parameter push takes into timings, if it
+	// isn't nullptr. The timings must outlive any rendering.
+	void setTimings(RenderTimings* timings) { myTimings = timings; }
+
+	int getNumBufferChannels() const { return myBuffer.getNumChannels(); }
+	int getMaximumBlockSize() const { return myMaximumBlockSize; }
+	int32_t getPrepareCount() const { return myPrepareCount; }
+
+private:
+
+	// process() and pushParameters() without the timing.
+	void renderBlock(juce::AudioBuffer<float>& buffer);
+	int sendParameters(int numValues, int firstValue);
+
+	std::unique_ptr<juce::AudioPluginInstance> myPlugin;
+
+	// Storage for a whole block on every channel the plugin can read or write.
+	juce::AudioSampleBuffer myBuffer;
+	// Refers to the first N samples of myBuffer for the block being rendered.
+	juce::AudioSampleBuffer myBlockBuffer;
+
+	juce::MidiBuffer myMidiBuffer;
+
+	// Filters for the oversampled rate, and a view of their upsampled block.
+	std::unique_ptr<juce::dsp::Oversampling<float>> myOversampling;
+	std::vector<float*> myOversampledChannels;
+	juce::AudioSampleBuffer myOversampledBuffer;
+
+	// myMidiBuffer with its timestamps moved to the oversampled rate.
+	juce::MidiBuffer myOversampledMidiBuffer;
+
+	// The last layout passed to setBusLayout(), if any.
+	bool myHasBusLayout = false;
+	bool myAllBuses = false;
+	int myMainBusChannels = 0;
+	bool myIsBusLayoutRejected = false;
+
+	int myOversamplingLog2 = 0;
+	juce::dsp::Oversampling<float>::FilterType myOversamplingFilter = juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR;
+
+	// Sized to the plugin's parameter count when the plugin is set.
+	std::vector<float> myPendingParameterValues;
+	std::vector<float> myLastParameterValues;
+	std::vector<float> myParameterDeltas;
+	// The parameters sent since the cache was invalidated, from first to end.
+	// Only values in this range can take the vectorized path, as a NaN last
+	// value could be lost in it. The CHOP may never supply the others.
+	int myFirstSentParameter = 0;
+	int myEndSentParameter = 0;
+
+	// What the plugin was last prepared for.
+	double myPreparedSampleRate = 0.;
+	int myMaximumBlockSize = 0;
+	int myNumInputChannels = 0;
+	int myNumOutputChannels = 0;
+	int myPreparedOversamplingLog2 = 0;
+	juce::dsp::Oversampling<float>::FilterType myPreparedOversamplingFilter = juce::dsp::Oversampling<float>::filterHalfBandPolyphaseIIR;
+	bool myPreparedNonRealtime = false;
+
+	int32_t myPrepareCount = 0;
+
+	RenderTimings* myTimings = nullptr;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PluginRenderer)
+};
@@ -0,0 +1,172 @@
+#include "RenderCache.h"
+
+#include <cstring>
+
+// FNV-1a, a word at a time.
+static const uint64_t kHashOffset = 14695981039346656037ull;
+static const uint64_t kHashPrime = 1099511628211ull;
+
+static inline uint64_t
+hashWord(uint64_t hash, uint32_t word)
+{
+	return (hash ^ word) * kHashPrime;
+}
+
+static inline uint32_t
+floatBits(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+bool
+RenderCache::isPreparedFor(int numChannels, int loopLength, int maximumBlockSize, size_t maximumBytes) const
+{
+	return myNumChannels == numChannels && myRequestedLoopLength == loopLength &&
+		myMaximumBlockSize == maximumBlockSize && myMaximumBytes == maximumBytes;
+}
+
+bool
+RenderCache::prepare(int numChannels, int loopLength, int maximumBlockSize, size_t maximumBytes)
+{
+	// Remember the request even if it doesn't fit, so isPreparedFor() doesn't ask again every cook.
+	myNumChannels = numChannels;
+	myRequestedLoopLength = loopLength;
+	myMaximumBlockSize = maximumBlockSize;
+	myMaximumBytes = maximumBytes;
+
+	const size_t numBytes = (size_t)std::max(0, loopLength) * (numChannels * sizeof(float) + sizeof(uint64_t));
+
+	if (loopLength <= 0 || numChannels <= 0 || numBytes > maximumBytes) {
+		myOutput.setSize(0, 0);
+		std::vector<uint64_t>().swap(myRecordedSignatures);
+		myLoopLength = 0;
+		return false;
+	}
+
+	myOutput.setSize(numChannels, loopLength);
+	myRecordedSignatures.assign(loopLength, 0);
+	mySignatures.assign(maximumBlockSize, 0);
+	myLoopLength = loopLength;
+	clear();
+
+	return true;
+}
+
+void
+RenderCache::clear()
+{
+	std::fill(myRecordedSignatures.begin(), myRecordedSignatures.end(), 0);
+	myPassMatches = false;
+	myPassSamples = 0;
+	myIsConfirmed = false;
+}
+
+size_t
+RenderCache::getNumBytes() const
+{
+	return myLoopLength > 0 ? (size_t)myLoopLength * (myNumChannels * sizeof(float) + sizeof(uint64_t)) : 0;
+}
+
+void
+RenderCache::sign(const float* const* input, int numInputChannels, const float* parameters, int numParameters,
+	const juce::MidiBuffer& midi, int numSamples)
+{
+	uint64_t blockHash = kHashOffset;
+
+	for (int i = 0; i < numParameters; i++)
+	{
+		blockHash = hashWord(blockHash, floatBits(parameters[i]));
+	}
+
+	uint64_t* signatures = mySignatures.data();
+
+	for (int samp = 0; samp < numSamples; samp++)
+	{
+		signatures[samp] = blockHash;
+	}
+
+	for (int chan = 0; input && chan < numInputChannels; chan++)
+	{
+		const float* data = input[chan];
+
+		for (int samp = 0; samp < numSamples; samp++)
+		{
+			signatures[samp] = hashWord(signatures[samp], floatBits(data[samp]));
+		}
+	}
+
+	for (const auto metadata : midi)
+	{
+		if (metadata.samplePosition < 0 || metadata.samplePosition >= numSamples) {
+			continue;
+		}
+
+		uint64_t& signature = signatures[metadata.samplePosition];
+
+		for (int i = 0; i < metadata.numBytes; i++)
+		{
+			signature = hashWord(signature, metadata.data[i]);
+		}
+
+		// Tell an event apart from the samples around it.
+		signature = hashWord(signature, 0xffffffffu);
+	}
+
+	// 0 is kept for samples that were never recorded.
+	for (int samp = 0; samp < numSamples; samp++)
+	{
+		signatures[samp] |= 1;
+	}
+}
+
+bool
+RenderCache::replay(int64_t position, float* const* output, int numChannels, int numSamples)
+{
+	const int offset = (int)(position % myLoopLength);
+
+	if (!myIsConfirmed || std::memcmp(mySignatures.data(), myRecordedSignatures.data() + offset, numSamples * sizeof(uint64_t)) != 0) {
+		// This pass is no longer the same as the last, so it can't confirm the loop either.
+		myIsConfirmed = false;
+		myPassMatches = false;
+		myMisses++;
+		return false;
+	}
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		juce::FloatVectorOperations::copy(output[chan], myOutput.getReadPointer(std::min(chan, myNumChannels - 1), offset), numSamples);
+	}
+
+	myHits++;
+	return true;
+}
+
+void
+RenderCache::record(int64_t position, const float* const* output, int numChannels, int numSamples)
+{
+	const int offset = (int)(position % myLoopLength);
+
+	if (offset == 0) {
+		myPassMatches = true;
+		myPassSamples = 0;
+	}
+
+	myPassMatches = myPassMatches &&
+		std::memcmp(mySignatures.data(), myRecordedSignatures.data() + offset, numSamples * sizeof(uint64_t)) == 0;
+	myPassSamples += numSamples;
+
+	for (int chan = 0; chan < std::min(numChannels, myNumChannels); chan++)
+	{
+		juce::FloatVectorOperations::copy(myOutput.getWritePointer(chan, offset), output[chan], numSamples);
+	}
+
+	std::memcpy(myRecordedSignatures.data() + offset, mySignatures.data(), numSamples * sizeof(uint64_t));
+
+	// A whole pass that matched the one before it was rendered after the same
+	// inputs, so its output has the tail of the loop's end at its start.
+	if (offset + numSamples == myLoopLength) {
+		myIsConfirmed = myPassMatches && myPassSamples == myLoopLength;
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <vector>
+
+// Remembers one loop period of a plugin's output, so that when the same
+// inputs come round again the output can be replayed instead of rendered.
+//
+// Every sample of the loop keeps a signature of what went into it: the input
+// audio, the MIDI events at that sample and the parameter values of its block.
+// A block is replayed only if all of its signatures match the ones recorded at
+// the same place in the loop, so cooks of any length line up. This only holds
+// for plugins whose output depends on nothing but those inputs.
+//
+// Nothing is replayed until a whole loop pass has been rendered with the same
+// signatures as the pass before it, so that the recorded output includes what
+// rings on from the end of the loop into its start. The first miss after that
+// stops replaying until another pass confirms the loop.
+class RenderCache
+{
+public:
+	// Sizes the cache for a loop, clearing it. Returns false, leaving the cache
+	// off, if the loop wouldn't fit in maximumBytes.
+	bool prepare(int numChannels, int loopLength, int maximumBlockSize, size_t maximumBytes);
+
+	bool isPreparedFor(int numChannels, int loopLength, int maximumBlockSize, size_t maximumBytes) const;
+
+	bool isEnabled() const { return myLoopLength > 0; }
+
+	int getLoopLength() const { return myLoopLength; }
+
+	// Forgets everything recorded, e.g. after the plugin or its state changed.
+	void clear();
+
+	// Works out the signatures of the next block, which must not cross the end
+	// of the loop. input may be nullptr.
+	void sign(const float* const* input, int numInputChannels, const float* parameters, int numParameters,
+		const juce::MidiBuffer& midi, int numSamples);
+
+	// Copies the recorded output to output if the loop is confirmed and every
+	// signature matches what was recorded at position, and counts a hit or a miss.
+	bool replay(int64_t position, float* const* output, int numChannels, int numSamples);
+
+	// Records a block that was rendered, with the signatures from sign(). The
+	// block that ends a pass confirms the loop if the whole pass matched.
+	void record(int64_t position, const float* const* output, int numChannels, int numSamples);
+
+	int64_t getHits() const { return myHits; }
+	int64_t getMisses() const { return myMisses; }
+	size_t getNumBytes() const;
+
+private:
+
+	juce::AudioBuffer<float> myOutput;
+
+	// 0 means nothing was recorded there.
+	std::vector<uint64_t> myRecordedSignatures;
+	std::vector<uint64_t> mySignatures;
+
+	// 0 while the cache is off.
+	int myLoopLength = 0;
+
+	int myNumChannels = 0;
+	int myRequestedLoopLength = 0;
+	int myMaximumBlockSize = 0;
+	size_t myMaximumBytes = 0;
+
+	// Whether the pass being recorded has matched the previous one so far, and
+	// how much of it was recorded.
+	bool myPassMatches = false;
+	int myPassSamples = 0;
+	bool myIsConfirmed = false;
+
+	int64_t myHits = 0;
+	int64_t myMisses = 0;
+};
@@ -0,0 +1,319 @@
+#include "RenderPipeline.h"
+
+// How many events can be queued ahead of the render thread. Events that don't
+// fit are dropped, so this is far more than a cook should ever produce.
+static const int kMaxQueuedEvents = 8192;
+
+// How many drops of input can be waiting for the render thread to reach them.
+static const int kMaxQueuedGaps = 256;
+
+// How long the render thread sleeps when there's nothing to render, in case a
+// notify() is missed.
+static const int kIdleWaitMs = 10;
+
+static const int kStopTimeoutMs = 1000;
+
+RenderPipeline::RenderPipeline(Client& client) : juce::Thread("TD-JUCE-VST render"), myClient(client)
+{
+}
+
+RenderPipeline::~RenderPipeline()
+{
+	stop();
+}
+
+bool
+RenderPipeline::isPreparedFor(double sampleRate, int numChannels, int maximumBlockSize, int latencySamples, bool fixedBlockSize) const
+{
+	return isRunning() &&
+		sampleRate == mySampleRate &&
+		numChannels == myNumChannels &&
+		maximumBlockSize == myMaximumBlockSize &&
+		latencySamples == myLatencySamples &&
+		fixedBlockSize == myFixedBlockSize;
+}
+
+void
+RenderPipeline::prepare(double sampleRate, int numChannels, int maximumBlockSize, int latencySamples, int capacity, bool fixedBlockSize)
+{
+	stop();
+
+	mySampleRate = sampleRate;
+	myNumChannels = numChannels;
+	myMaximumBlockSize = maximumBlockSize;
+	myLatencySamples = latencySamples;
+	myFixedBlockSize = fixedBlockSize;
+
+	// An AbstractFifo holds one item less than its size.
+	capacity = std::max(capacity, latencySamples + maximumBlockSize) + 1;
+
+	myInputFifo.setTotalSize(capacity);
+	myInputStorage.setSize(numChannels, capacity);
+	myOutputFifo.setTotalSize(capacity);
+	myOutputStorage.setSize(numChannels, capacity);
+	myOutputStorage.clear();
+
+	myEventFifo.setTotalSize(kMaxQueuedEvents + 1);
+	myEventStorage.resize(kMaxQueuedEvents + 1);
+
+	myGapFifo.setTotalSize(kMaxQueuedGaps + 1);
+	myGapStorage.resize(kMaxQueuedGaps + 1);
+
+	myBlockInput.setSize(numChannels, maximumBlockSize);
+	myBlockOutput.setSize(numChannels, maximumBlockSize);
+	// The parameter events get the MIDI events appended to them.
+	myBlockEvents.reserve(2 * kMaxQueuedEvents);
+	myBlockMidiEvents.reserve(kMaxQueuedEvents);
+
+	// The storage is silent, so priming the output is only a matter of moving the write index.
+	myOutputFifo.finishedWrite(latencySamples);
+
+	myRenderPosition = 0;
+	myWritePosition = 0;
+	myPendingSkip = 0;
+	myUnderrunCount = 0;
+
+	startThread(realtimeAudioPriority);
+}
+
+void
+RenderPipeline::stop()
+{
+	stopThread(kStopTimeoutMs);
+}
+
+bool
+RenderPipeline::pushEvent(const Event& event)
+{
+	int start1, size1, start2, size2;
+	myEventFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+	if (size1 + size2 == 0) {
+		return false;
+	}
+
+	myEventStorage[size1 > 0 ? start1 : start2] = event;
+	myEventFifo.finishedWrite(1);
+
+	return true;
+}
+
+bool
+RenderPipeline::pushParameter(int64_t time, int index, float value)
+{
+	Event event = {};
+	event.time = time;
+	event.type = Event::Parameter;
+	event.index = index;
+	event.value = value;
+
+	return pushEvent(event);
+}
+
+bool
+RenderPipeline::pushMidi(int64_t time, const juce::uint8* data, int size)
+{
+	Event event = {};
+	event.time = time;
+	event.type = Event::Midi;
+	event.midiSize = std::min(size, (int)sizeof(event.midiData));
+	memcpy(event.midiData, data, event.midiSize);
+
+	return pushEvent(event);
+}
+
+void
+RenderPipeline::process(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples)
+{
+	using namespace juce;
+
+	int start1, size1, start2, size2;
+
+	// Input that doesn't fit is dropped.
+	myInputFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+	for (int chan = 0; chan < myNumChannels; chan++)
+	{
+		float* storage = myInputStorage.getWritePointer(chan);
+
+		// Channels the input doesn't have are silent.
+		if (input && chan < numInputChannels) {
+			const float* source = input[chan];
+			FloatVectorOperations::copy(storage + start1, source, size1);
+			FloatVectorOperations::copy(storage + start2, source + size1, size2);
+		}
+		else {
+			FloatVectorOperations::clear(storage + start1, size1);
+			FloatVectorOperations::clear(storage + start2, size2);
+		}
+	}
+
+	const int numWritten = size1 + size2;
+	myInputFifo.finishedWrite(numWritten);
+
+	// The dropped input still takes up its time, so the events after it stay in step.
+	if (numWritten < numSamples) {
+		myGapFifo.prepareToWrite(1, start1, size1, start2, size2);
+
+		if (size1 + size2 > 0) {
+			myGapStorage[size1 > 0 ? start1 : start2] = { myWritePosition + numWritten, numSamples - numWritten };
+			myGapFifo.finishedWrite(1);
+		}
+	}
+
+	myWritePosition += numSamples;
+
+	notify();
+
+	// Throw away samples that arrived after their cook gave up on them.
+	const int numSkipped = std::min(myPendingSkip, myOutputFifo.getNumReady());
+	myOutputFifo.finishedRead(numSkipped);
+	myPendingSkip -= numSkipped;
+
+	myOutputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+	const int numRead = size1 + size2;
+
+	for (int chan = 0; chan < numOutputChannels; chan++)
+	{
+		float* dest = output[chan];
+
+		if (chan < myNumChannels) {
+			const float* storage = myOutputStorage.getReadPointer(chan);
+			FloatVectorOperations::copy(dest, storage + start1, size1);
+			FloatVectorOperations::copy(dest + size1, storage + start2, size2);
+		}
+		else {
+			FloatVectorOperations::clear(dest, numRead);
+		}
+
+		FloatVectorOperations::clear(dest + numRead, numSamples - numRead);
+	}
+
+	myOutputFifo.finishedRead(numRead);
+
+	if (numRead < numSamples) {
+		myPendingSkip += numSamples - numRead;
+		myUnderrunCount++;
+	}
+}
+
+bool
+RenderPipeline::renderNextBlock()
+{
+	using namespace juce;
+
+	int numSamples = std::min(myMaximumBlockSize, myInputFifo.getNumReady());
+	numSamples = std::min(numSamples, myOutputFifo.getFreeSpace());
+
+	if (numSamples <= 0 || (myFixedBlockSize && numSamples < myMaximumBlockSize)) {
+		return false;
+	}
+
+	// Skip the time of any input the cook thread dropped. A block ends where
+	// the next drop starts, unless the block size is fixed, in which case
+	// drops within the block are skipped at its start and its events land there.
+	while (myGapFifo.getNumReady() > 0)
+	{
+		int start1, size1, start2, size2;
+		myGapFifo.prepareToRead(1, start1, size1, start2, size2);
+
+		const Gap gap = myGapStorage[size1 > 0 ? start1 : start2];
+		const int64_t offset = gap.time - myRenderPosition;
+
+		if (offset >= numSamples) {
+			break;
+		}
+
+		if (offset > 0 && !myFixedBlockSize) {
+			numSamples = (int)offset;
+			break;
+		}
+
+		myRenderPosition += gap.numSamples;
+		myGapFifo.finishedRead(1);
+	}
+
+	myBlockEvents.clear();
+	myBlockMidiEvents.clear();
+
+	// Take the events before the end of the block. A parameter event after the
+	// start ends the block early so that it starts the next one, unless the
+	// block size is fixed.
+	while (myEventFifo.getNumReady() > 0)
+	{
+		int start1, size1, start2, size2;
+		myEventFifo.prepareToRead(1, start1, size1, start2, size2);
+
+		Event event = myEventStorage[size1 > 0 ? start1 : start2];
+		const int64_t offset = event.time - myRenderPosition;
+
+		if (offset >= numSamples) {
+			break;
+		}
+
+		if (event.type == Event::Parameter && offset > 0 && !myFixedBlockSize) {
+			numSamples = (int)offset;
+			break;
+		}
+
+		myEventFifo.finishedRead(1);
+
+		// Late events land at the start of the block.
+		event.time = std::max<int64_t>(0, offset);
+
+		auto& events = event.type == Event::Parameter ? myBlockEvents : myBlockMidiEvents;
+		if ((int)events.size() < kMaxQueuedEvents) {
+			events.push_back(event);
+		}
+	}
+
+	myBlockEvents.insert(myBlockEvents.end(), myBlockMidiEvents.begin(), myBlockMidiEvents.end());
+
+	int start1, size1, start2, size2;
+	myInputFifo.prepareToRead(numSamples, start1, size1, start2, size2);
+
+	for (int chan = 0; chan < myNumChannels; chan++)
+	{
+		const float* storage = myInputStorage.getReadPointer(chan);
+		float* dest = myBlockInput.getWritePointer(chan);
+		FloatVectorOperations::copy(dest, storage + start1, size1);
+		FloatVectorOperations::copy(dest + size1, storage + start2, size2);
+	}
+
+	myInputFifo.finishedRead(numSamples);
+
+	{
+		const ScopedLock sl(myRenderLock);
+
+		myClient.renderPipelineBlock(myBlockInput.getArrayOfReadPointers(), myBlockOutput.getArrayOfWritePointers(),
+			myNumChannels, numSamples, myBlockEvents.data(), (int)myBlockEvents.size());
+	}
+
+	myOutputFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+	for (int chan = 0; chan < myNumChannels; chan++)
+	{
+		const float* source = myBlockOutput.getReadPointer(chan);
+		float* storage = myOutputStorage.getWritePointer(chan);
+		FloatVectorOperations::copy(storage + start1, source, size1);
+		FloatVectorOperations::copy(storage + start2, source + size1, size2);
+	}
+
+	myOutputFifo.finishedWrite(numSamples);
+	myRenderPosition += numSamples;
+
+	return true;
+}
+
+void
+RenderPipeline::run()
+{
+	juce::ScopedNoDenormals noDenormals;
+
+	while (!threadShouldExit())
+	{
+		if (!renderNextBlock()) {
+			wait(kIdleWaitMs);
+		}
+	}
+}
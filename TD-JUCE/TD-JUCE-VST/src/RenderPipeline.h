@@ -0,0 +1,148 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+#include <vector>
+
+// Renders audio on a dedicated thread, a fixed latency ahead of the cook thread.
+//
+// Each cook the cook thread queues the parameter and MIDI events for its
+// samples, then writes its input audio and reads the same number of rendered
+// samples back out. Audio and events move through single-producer,
+// single-consumer FIFOs, so neither side waits on the other. The render thread
+// renders whatever input has arrived in blocks of up to the maximum block
+// size, splitting a block wherever a parameter event lands. With a fixed block
+// size it waits for a whole block instead, and a block's parameter events all
+// land at its start.
+//
+// The output starts with the latency's worth of silence. If the render thread
+// falls behind, the missing samples are output as silence and the late ones
+// are skipped when they arrive, so the latency stays the same. Input that
+// doesn't fit is dropped, and the render thread's sample times skip over it so
+// that the events after it still land on their samples.
+class RenderPipeline : private juce::Thread
+{
+public:
+	// A parameter change or a MIDI message, timestamped in samples since the
+	// pipeline was prepared. Once it reaches the render thread the time is
+	// relative to the start of the block.
+	struct Event
+	{
+		enum Type
+		{
+			Parameter = 0,
+			Midi
+		};
+
+		int64_t time;
+		int32_t type;
+		int32_t index;
+		float value;
+		int32_t midiSize;
+		juce::uint8 midiData[4];
+	};
+
+	// Renders a block on the render thread, from input into output. The block's
+	// parameter events all have a time of 0, and are followed by its MIDI events.
+	class Client
+	{
+	public:
+		virtual ~Client() = default;
+		virtual void renderPipelineBlock(const float* const* input, float* const* output, int numChannels, int numSamples,
+			const Event* events, int numEvents) = 0;
+	};
+
+	explicit RenderPipeline(Client& client);
+	~RenderPipeline();
+
+	// Stops the render thread, then starts it again with empty FIFOs, primed
+	// with latencySamples of silence.
+	void prepare(double sampleRate, int numChannels, int maximumBlockSize, int latencySamples, int capacity, bool fixedBlockSize = false);
+
+	// Stops the render thread, dropping anything in flight.
+	void stop();
+
+	bool isRunning() const { return isThreadRunning(); }
+
+	// True if prepare() would be a no-op for these settings.
+	bool isPreparedFor(double sampleRate, int numChannels, int maximumBlockSize, int latencySamples, bool fixedBlockSize = false) const;
+
+	// What the pipeline was prepared with, for the client to use on the render
+	// thread. They only change while the render thread is stopped.
+	double getSampleRate() const { return mySampleRate; }
+	int getMaximumBlockSize() const { return myMaximumBlockSize; }
+
+	// The sample time of the next sample the cook thread will write.
+	int64_t getWritePosition() const { return myWritePosition; }
+
+	// Queues an event for the render thread. Returns false if the queue is full.
+	bool pushParameter(int64_t time, int index, float value);
+	bool pushMidi(int64_t time, const juce::uint8* data, int size);
+
+	// Writes a cook's input (or silence when input is nullptr, and for channels
+	// past numInputChannels), then reads the same number of rendered samples into
+	// output. Called on the cook thread.
+	void process(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples);
+
+	// Held by the render thread while it renders a block. The cook thread takes
+	// it to change anything the render thread reads, such as the plugin.
+	juce::CriticalSection& getRenderLock() { return myRenderLock; }
+
+	int getLatencySamples() const { return isRunning() ? myLatencySamples : 0; }
+
+	// How many times the cook thread found fewer samples ready than it needed.
+	int32_t getUnderrunCount() const { return myUnderrunCount; }
+
+private:
+
+	void run() override;
+
+	// Renders one block of the available input. Returns false if there's none.
+	bool renderNextBlock();
+
+	bool pushEvent(const Event& event);
+
+	Client& myClient;
+
+	juce::CriticalSection myRenderLock;
+
+	// Audio going to and coming back from the render thread.
+	juce::AbstractFifo myInputFifo { 1 };
+	juce::AudioBuffer<float> myInputStorage;
+	juce::AbstractFifo myOutputFifo { 1 };
+	juce::AudioBuffer<float> myOutputStorage;
+
+	juce::AbstractFifo myEventFifo { 1 };
+	std::vector<Event> myEventStorage;
+
+	// Where the cook thread dropped input, and how much.
+	struct Gap
+	{
+		int64_t time;
+		int64_t numSamples;
+	};
+
+	juce::AbstractFifo myGapFifo { 1 };
+	std::vector<Gap> myGapStorage;
+
+	// The block being rendered, and its events. Only touched by the render thread.
+	juce::AudioBuffer<float> myBlockInput;
+	juce::AudioBuffer<float> myBlockOutput;
+	std::vector<Event> myBlockEvents;
+	std::vector<Event> myBlockMidiEvents;
+	int64_t myRenderPosition = 0;
+
+	// Only touched by the cook thread.
+	int64_t myWritePosition = 0;
+	int myPendingSkip = 0;
+	std::atomic<int32_t> myUnderrunCount { 0 };
+
+	double mySampleRate = 0.;
+	int myNumChannels = 0;
+	int myMaximumBlockSize = 0;
+	int myLatencySamples = 0;
+	bool myFixedBlockSize = false;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderPipeline)
+};
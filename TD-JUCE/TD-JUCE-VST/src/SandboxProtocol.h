@@ -0,0 +1,135 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+#include <cstdint>
+
+// The layout of the memory shared between a SandboxedPlugin and the helper
+// process hosting its plugin.
+//
+// The memory starts with a Header, followed by the Slot for the block in
+// flight: the audio on every channel, the parameter changes and MIDI events
+// that go with it, and the transport. The host fills the slot for block n,
+// sets submitted to n + 1 and signals the helper; the helper renders the audio
+// and MIDI in place, sets completed to n + 1 and signals back (see
+// SandboxSignal). The host waits for each block before sending the next, so
+// the sandbox adds no latency.
+//
+// Control messages (loading, preparing, presets, state) go over the JUCE child process
+// connection instead, as JSON.
+namespace SandboxProtocol
+{
+	// Passed on the helper's command line so it knows it was launched by us.
+	static const char* const kCommandLineId = "td-juce-vst-sandbox";
+
+	static const char* const kHelperName =
+#if JUCE_WINDOWS
+		"TD-JUCE-VSTHost.exe";
+#else
+		"TD-JUCE-VSTHost";
+#endif
+
+	static const uint32_t kMagic = 0x54445653;  // "TDVS"
+
+	static const int kNumSlots = 1;
+	static const int kMaxParameterChanges = 256;
+	static const int kMaxMidiEvents = 256;
+
+	struct Header
+	{
+		uint32_t magic;
+		int32_t numChannels;
+		int32_t maximumBlockSize;
+		int32_t numSlots;
+
+		// On their own cache lines, as each is written by a different process.
+		alignas(64) std::atomic<uint32_t> submitted;
+		alignas(64) std::atomic<uint32_t> completed;
+	};
+
+	struct ParameterChange
+	{
+		int32_t index;
+		float value;
+	};
+
+	// Events longer than 4 bytes, like SysEx, don't travel.
+	struct MidiEvent
+	{
+		int32_t samplePosition;
+		int32_t numBytes;
+		uint8_t data[4];
+	};
+
+	struct Transport
+	{
+		double bpm;
+		double timeInSeconds;
+		double ppqPosition;
+		double ppqPositionOfLastBarStart;
+		double ppqLoopStart;
+		double ppqLoopEnd;
+		int64_t timeInSamples;
+		int32_t timeSigNumerator;
+		int32_t timeSigDenominator;
+		int32_t isPlaying;
+		int32_t isLooping;
+	};
+
+	struct Slot
+	{
+		int32_t numSamples;
+		int32_t hasTransport;
+		Transport transport;
+
+		// The host's setNonRealtime(), applied to the plugin before the block.
+		int32_t isNonRealtime;
+
+		int32_t numParameterChanges;
+		ParameterChange parameterChanges[kMaxParameterChanges];
+
+		// The block's input events, replaced by the plugin's output events.
+		int32_t numMidiEvents;
+		MidiEvent midiEvents[kMaxMidiEvents];
+
+		// Written by the helper after rendering, as plugins can change it at any time.
+		int32_t latencySamples;
+
+		// Followed by numChannels * maximumBlockSize floats, a channel at a time.
+	};
+
+	inline size_t roundUpToCacheLine(size_t size)
+	{
+		return (size + 63) & ~(size_t)63;
+	}
+
+	inline size_t getSlotSize(int numChannels, int maximumBlockSize)
+	{
+		return roundUpToCacheLine(sizeof(Slot)) + roundUpToCacheLine(sizeof(float) * (size_t)numChannels * (size_t)maximumBlockSize);
+	}
+
+	inline size_t getMemorySize(int numChannels, int maximumBlockSize)
+	{
+		return roundUpToCacheLine(sizeof(Header)) + kNumSlots * getSlotSize(numChannels, maximumBlockSize);
+	}
+
+	inline Header* getHeader(void* memory)
+	{
+		return static_cast<Header*>(memory);
+	}
+
+	inline Slot* getSlot(void* memory, uint32_t block)
+	{
+		const auto* header = getHeader(memory);
+		auto* slots = static_cast<char*>(memory) + roundUpToCacheLine(sizeof(Header));
+		return reinterpret_cast<Slot*>(slots + (block % (uint32_t)header->numSlots) * getSlotSize(header->numChannels, header->maximumBlockSize));
+	}
+
+	inline float* getChannel(void* memory, Slot* slot, int chan)
+	{
+		const auto* header = getHeader(memory);
+		auto* audio = reinterpret_cast<char*>(slot) + roundUpToCacheLine(sizeof(Slot));
+		return reinterpret_cast<float*>(audio) + (size_t)chan * (size_t)header->maximumBlockSize;
+	}
+}
@@ -0,0 +1,189 @@
+#include "SandboxSignal.h"
+
+#if JUCE_WINDOWS
+#include <windows.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <semaphore.h>
+#endif
+
+static std::string
+getSystemName(const juce::String& name)
+{
+#if JUCE_WINDOWS
+	return ("Local\\" + name).toStdString();
+#else
+	return ("/" + name).toStdString();
+#endif
+}
+
+SandboxSignal::~SandboxSignal()
+{
+	close();
+}
+
+bool
+SandboxSignal::create(const juce::String& name)
+{
+	close();
+
+#if JUCE_WINDOWS
+	// Auto-reset, so each wakeup takes one signal.
+	myHandle = CreateEventA(nullptr, FALSE, FALSE, getSystemName(name).c_str());
+
+	if (myHandle && GetLastError() == ERROR_ALREADY_EXISTS) {
+		close();
+	}
+#else
+	sem_t* semaphore = sem_open(getSystemName(name).c_str(), O_CREAT | O_EXCL, 0600, 0);
+
+	if (semaphore != SEM_FAILED) {
+		myHandle = semaphore;
+		myCreatedName = name;
+	}
+#endif
+
+	return isOpen();
+}
+
+bool
+SandboxSignal::open(const juce::String& name)
+{
+	close();
+
+#if JUCE_WINDOWS
+	myHandle = OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, getSystemName(name).c_str());
+#else
+	sem_t* semaphore = sem_open(getSystemName(name).c_str(), 0);
+
+	if (semaphore != SEM_FAILED) {
+		myHandle = semaphore;
+
+		// Both sides have it now, so the name can go. That way it doesn't outlive
+		// a helper that crashes.
+		sem_unlink(getSystemName(name).c_str());
+	}
+#endif
+
+	return isOpen();
+}
+
+void
+SandboxSignal::close()
+{
+	if (!myHandle) {
+		return;
+	}
+
+#if JUCE_WINDOWS
+	CloseHandle(myHandle);
+#else
+	sem_close(static_cast<sem_t*>(myHandle));
+
+	if (myCreatedName.isNotEmpty()) {
+		sem_unlink(getSystemName(myCreatedName).c_str());
+		myCreatedName = juce::String();
+	}
+#endif
+
+	myHandle = nullptr;
+}
+
+void
+SandboxSignal::signal()
+{
+	if (!myHandle) {
+		return;
+	}
+
+#if JUCE_WINDOWS
+	SetEvent(myHandle);
+#else
+	sem_post(static_cast<sem_t*>(myHandle));
+#endif
+}
+
+bool
+SandboxSignal::wait(int timeoutMs)
+{
+	if (!myHandle) {
+		return false;
+	}
+
+#if JUCE_WINDOWS
+	return WaitForSingleObject(myHandle, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs) == WAIT_OBJECT_0;
+#else
+	auto* semaphore = static_cast<sem_t*>(myHandle);
+
+	if (timeoutMs < 0) {
+		while (sem_wait(semaphore) != 0)
+		{
+			if (errno != EINTR) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+#if JUCE_MAC
+	// macOS has no sem_timedwait, so a timed wait has to poll.
+	const auto start = juce::Time::getMillisecondCounter();
+
+	while (sem_trywait(semaphore) != 0)
+	{
+		if ((int)(juce::Time::getMillisecondCounter() - start) >= timeoutMs) {
+			return false;
+		}
+
+		juce::Thread::sleep(1);
+	}
+
+	return true;
+#else
+	timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+
+	deadline.tv_sec += timeoutMs / 1000;
+	deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	while (sem_timedwait(semaphore, &deadline) != 0)
+	{
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+
+	return true;
+#endif
+#endif
+}
+
+bool
+SandboxSignal::waitFor(const std::atomic<uint32_t>& counter, uint32_t target, int timeoutMs, const std::atomic<bool>& cancelled)
+{
+	const auto start = juce::Time::getMillisecondCounter();
+
+	for (;;)
+	{
+		// Always wait before checking, so the signal that goes with this move of
+		// the counter is taken now rather than waking the next call for nothing.
+		const int remainingMs = timeoutMs - (int)(juce::Time::getMillisecondCounter() - start);
+		const bool wasSignalled = remainingMs >= 0 && wait(remainingMs);
+
+		if ((int32_t)(counter.load(std::memory_order_acquire) - target) >= 0) {
+			return true;
+		}
+
+		if (!wasSignalled || cancelled) {
+			return false;
+		}
+	}
+}
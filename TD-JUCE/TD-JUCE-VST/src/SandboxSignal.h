@@ -0,0 +1,51 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <atomic>
+#include <cstdint>
+
+// Wakes the other side of the sandbox when a block is ready, so neither the
+// CHOP nor the helper polls the shared memory. It's a named event on Windows
+// and a named semaphore elsewhere.
+//
+// The helper create()s both signals and sends their name to the CHOP, which
+// open()s them.
+class SandboxSignal
+{
+public:
+	SandboxSignal() = default;
+	~SandboxSignal();
+
+	// Returns false if a signal with that name already exists or can't be made.
+	bool create(const juce::String& name);
+
+	// Opens a signal the other process created. Returns false if there's none.
+	bool open(const juce::String& name);
+
+	void close();
+
+	bool isOpen() const { return myHandle != nullptr; }
+
+	// Wakes the next wait(), whether or not anything is waiting yet.
+	void signal();
+
+	// Waits up to timeoutMs for signal(), or forever if it's negative. Returns
+	// false on timeout.
+	bool wait(int timeoutMs);
+
+	// Waits for counter to reach target, counting with wraparound. The side that
+	// moves the counter signals once after every move, so each wakeup here takes
+	// one signal. Returns false on timeout, or once cancelled is set and signalled.
+	bool waitFor(const std::atomic<uint32_t>& counter, uint32_t target, int timeoutMs, const std::atomic<bool>& cancelled);
+
+private:
+
+	// A HANDLE on Windows, a sem_t* elsewhere.
+	void* myHandle = nullptr;
+
+	// The name to unlink when this side created a POSIX semaphore.
+	juce::String myCreatedName;
+
+	JUCE_DECLARE_NON_COPYABLE(SandboxSignal)
+};
@@ -0,0 +1,560 @@
+#include "SandboxedPlugin.h"
+
+#include <cstring>
+
+// Loading can involve scanning the plugin, so give it plenty of time.
+static const int kLoadTimeoutMs = 60000;
+// How long a block can take before the helper is given up on.
+static const int kBlockTimeoutMs = 2000;
+// How often a request checks whether its thread should exit while it waits.
+static const int kReplyWaitMs = 100;
+
+// The connection to a helper process. Requests are sent one at a time, and
+// the reply is matched up by its id. Messages arrive on the connection's own
+// thread, so this works without a JUCE message loop.
+class SandboxConnection : public juce::ChildProcessMaster
+{
+public:
+	~SandboxConnection() override
+	{
+		killSlaveProcess();
+	}
+
+	// Sends a request and waits for the reply. Returns a void var if the
+	// helper couldn't be reached or didn't answer in time, or if the calling
+	// thread is told to exit first.
+	juce::var request(const juce::String& type, juce::DynamicObject::Ptr arguments, int timeoutMs)
+	{
+		using namespace juce;
+
+		const ScopedLock sl(myRequestLock);
+
+		if (myHasLostConnection) {
+			return {};
+		}
+
+		DynamicObject::Ptr message = arguments != nullptr ? arguments : new DynamicObject();
+		message->setProperty("type", type);
+
+		{
+			const ScopedLock rl(myReplyLock);
+			message->setProperty("id", ++myRequestId);
+			myReply = var();
+			myReplyEvent.reset();
+		}
+
+		const String json = JSON::toString(var(message.get()), true);
+
+		if (!sendMessageToSlave(MemoryBlock(json.toRawUTF8(), json.getNumBytesAsUTF8()))) {
+			return {};
+		}
+
+		const auto start = Time::getMillisecondCounter();
+
+		while (!myReplyEvent.wait(kReplyWaitMs))
+		{
+			if (Thread::currentThreadShouldExit() || (int)(Time::getMillisecondCounter() - start) >= timeoutMs) {
+				return {};
+			}
+		}
+
+		const ScopedLock rl(myReplyLock);
+		return myReply;
+	}
+
+	const std::atomic<bool>& hasLostConnection() const { return myHasLostConnection; }
+
+	// Opens the signals the helper made for the shared memory. Returns false
+	// if it can't.
+	bool openSignals(const juce::String& name)
+	{
+		const juce::ScopedLock rl(myReplyLock);
+		return mySubmittedSignal.open(name + "-s") && myCompletedSignal.open(name + "-c");
+	}
+
+	// Signalled after a block is submitted, to wake the helper.
+	SandboxSignal& getSubmittedSignal() { return mySubmittedSignal; }
+
+	// Signalled by the helper after a block is completed, and once the
+	// connection is lost.
+	SandboxSignal& getCompletedSignal() { return myCompletedSignal; }
+
+private:
+
+	void handleMessageFromSlave(const juce::MemoryBlock& message) override
+	{
+		using namespace juce;
+
+		auto reply = JSON::parse(message.toString());
+
+		const ScopedLock rl(myReplyLock);
+
+		// A late reply to a request that already timed out.
+		if ((int)reply["id"] != myRequestId) {
+			return;
+		}
+
+		myReply = reply;
+		myReplyEvent.signal();
+	}
+
+	void handleConnectionLost() override
+	{
+		const juce::ScopedLock rl(myReplyLock);
+
+		myHasLostConnection = true;
+		myReplyEvent.signal();
+		myCompletedSignal.signal();
+	}
+
+	juce::CriticalSection myRequestLock;
+
+	juce::CriticalSection myReplyLock;
+	juce::WaitableEvent myReplyEvent { true };
+	juce::var myReply;
+	int myRequestId = 0;
+
+	std::atomic<bool> myHasLostConnection { false };
+
+	SandboxSignal mySubmittedSignal;
+	SandboxSignal myCompletedSignal;
+};
+
+// Mirrors one of the real plugin's parameters. Setting it only marks it to
+// be sent with the next block.
+class SandboxedPlugin::Parameter : public juce::AudioProcessorParameter
+{
+public:
+	Parameter(SandboxedPlugin& owner, int index, const juce::var& info) :
+		myOwner(owner),
+		myIndex(index),
+		myName(info["name"].toString()),
+		myLabel(info["label"].toString()),
+		myNumSteps(info["numSteps"]),
+		myIsDiscrete(info["discrete"]),
+		myDefaultValue(info["defaultValue"])
+	{
+	}
+
+	float getValue() const override { return myValue; }
+
+	void setValue(float newValue) override
+	{
+		myValue = newValue;
+		myOwner.parameterChanged(myIndex);
+	}
+
+	// Takes a value that came from the helper, without sending it back.
+	void setValueFromHelper(float newValue) { myValue = newValue; }
+
+	float getDefaultValue() const override { return myDefaultValue; }
+	juce::String getName(int maximumStringLength) const override { return myName.substring(0, maximumStringLength); }
+	juce::String getLabel() const override { return myLabel; }
+	int getNumSteps() const override { return myNumSteps; }
+	bool isDiscrete() const override { return myIsDiscrete; }
+	float getValueForText(const juce::String& text) const override { return text.getFloatValue(); }
+
+private:
+
+	SandboxedPlugin& myOwner;
+	const int myIndex;
+	const juce::String myName;
+	const juce::String myLabel;
+	const int myNumSteps;
+	const bool myIsDiscrete;
+	const float myDefaultValue;
+
+	std::atomic<float> myValue { 0.f };
+};
+
+static juce::AudioProcessor::BusesProperties
+getBusesProperties(const juce::var& description)
+{
+	using namespace juce;
+
+	AudioProcessor::BusesProperties buses;
+
+	const int numInputChannels = description["numInputChannels"];
+	const int numOutputChannels = description["numOutputChannels"];
+
+	if (numInputChannels > 0) {
+		buses = buses.withInput("Input", AudioChannelSet::discreteChannels(numInputChannels), true);
+	}
+
+	if (numOutputChannels > 0) {
+		buses = buses.withOutput("Output", AudioChannelSet::discreteChannels(numOutputChannels), true);
+	}
+
+	return buses;
+}
+
+SandboxedPlugin::SandboxedPlugin(std::unique_ptr<SandboxConnection> connection, const juce::var& description) :
+	juce::AudioPluginInstance(getBusesProperties(description)),
+	myConnection(std::move(connection))
+{
+	myName = description["name"].toString();
+	myTailLengthSeconds = description["tailLengthSeconds"];
+	myAcceptsMidi = description["acceptsMidi"];
+	myProducesMidi = description["producesMidi"];
+
+	myDescription.name = myName;
+	myDescription.descriptiveName = myName;
+	myDescription.pluginFormatName = "Sandboxed";
+	myDescription.fileOrIdentifier = description["plugin"].toString();
+	myDescription.numInputChannels = description["numInputChannels"];
+	myDescription.numOutputChannels = description["numOutputChannels"];
+	myDescription.isInstrument = myAcceptsMidi && myDescription.numInputChannels == 0;
+
+	if (auto* parameters = description["parameters"].getArray()) {
+		for (int i = 0; i < parameters->size(); i++)
+		{
+			auto* parameter = new Parameter(*this, i, parameters->getReference(i));
+			addParameter(parameter);
+			myParameters.push_back(parameter);
+		}
+	}
+
+	myChangedParameters.reserve(myParameters.size());
+	myParameterIsChanged.assign(myParameters.size(), 0);
+
+	updateParameterValues(description["values"]);
+	setLatencySamples(description["latencySamples"]);
+}
+
+SandboxedPlugin::~SandboxedPlugin()
+{
+	// Unmap before the helper goes, so it can delete the file.
+	myMemory.reset();
+	myConnection.reset();
+}
+
+std::unique_ptr<SandboxedPlugin>
+SandboxedPlugin::create(const std::string& pluginPath, const std::string& presetPath,
+	double sampleRate, int blockSize, std::string& errorMessage)
+{
+	using namespace juce;
+
+	// Looked for next to this DLL, where the build copies it.
+	const auto helper = File::getSpecialLocation(File::currentExecutableFile).getSiblingFile(SandboxProtocol::kHelperName);
+
+	if (!helper.existsAsFile()) {
+		errorMessage = "Sandbox helper not found: " + helper.getFullPathName().toStdString();
+		return nullptr;
+	}
+
+	auto connection = std::make_unique<SandboxConnection>();
+
+	if (!connection->launchSlaveProcess(helper, SandboxProtocol::kCommandLineId)) {
+		errorMessage = "Couldn't start the sandbox helper";
+		return nullptr;
+	}
+
+	auto* arguments = new DynamicObject();
+	arguments->setProperty("plugin", String(pluginPath));
+	arguments->setProperty("preset", String(presetPath));
+	arguments->setProperty("sampleRate", sampleRate);
+	arguments->setProperty("blockSize", blockSize);
+
+	auto reply = connection->request("load", arguments, kLoadTimeoutMs);
+
+	if (reply.isVoid()) {
+		errorMessage = "The sandbox helper stopped responding while loading " + pluginPath;
+		return nullptr;
+	}
+
+	if (!(bool)reply["ok"]) {
+		errorMessage = reply["error"].toString().toStdString();
+		return nullptr;
+	}
+
+	if (!connection->openSignals(reply["signals"].toString())) {
+		errorMessage = "Couldn't open the sandbox helper's signals";
+		return nullptr;
+	}
+
+	std::unique_ptr<SandboxedPlugin> plugin(new SandboxedPlugin(std::move(connection), reply));
+
+	if (!plugin->mapMemory(reply["memory"].toString())) {
+		errorMessage = "Couldn't map the sandbox helper's shared memory";
+		return nullptr;
+	}
+
+	plugin->myPreparedSampleRate = sampleRate;
+	plugin->myPreparedBlockSize = blockSize;
+
+	return plugin;
+}
+
+bool
+SandboxedPlugin::hasFailed() const
+{
+	return myHasFailed || myConnection->hasLostConnection();
+}
+
+juce::var
+SandboxedPlugin::request(const juce::String& type, juce::DynamicObject::Ptr arguments, int timeoutMs)
+{
+	if (hasFailed()) {
+		return {};
+	}
+
+	return myConnection->request(type, arguments, timeoutMs);
+}
+
+bool
+SandboxedPlugin::mapMemory(const juce::String& path)
+{
+	using namespace juce;
+
+	myMemory.reset();
+
+	if (path.isEmpty()) {
+		return false;
+	}
+
+	auto memory = std::make_unique<MemoryMappedFile>(File(path), MemoryMappedFile::readWrite);
+
+	if (memory->getData() == nullptr || memory->getSize() < sizeof(SandboxProtocol::Header)) {
+		return false;
+	}
+
+	const auto* header = SandboxProtocol::getHeader(memory->getData());
+
+	if (header->magic != SandboxProtocol::kMagic ||
+		memory->getSize() < SandboxProtocol::getMemorySize(header->numChannels, header->maximumBlockSize)) {
+		return false;
+	}
+
+	myMemory = std::move(memory);
+	myNextBlock = 0;
+
+	return true;
+}
+
+void
+SandboxedPlugin::updateParameterValues(const juce::var& values)
+{
+	if (auto* array = values.getArray()) {
+		for (int i = 0; i < std::min(array->size(), (int)myParameters.size()); i++)
+		{
+			myParameters[i]->setValueFromHelper(array->getReference(i));
+		}
+	}
+}
+
+void
+SandboxedPlugin::fail()
+{
+	myHasFailed = true;
+}
+
+void
+SandboxedPlugin::parameterChanged(int index)
+{
+	if (!myParameterIsChanged[index]) {
+		myParameterIsChanged[index] = 1;
+		myChangedParameters.push_back(index);
+	}
+}
+
+void
+SandboxedPlugin::prepareToPlay(double sampleRate, int maximumBlockSize)
+{
+	using namespace juce;
+
+	if (sampleRate == myPreparedSampleRate && maximumBlockSize == myPreparedBlockSize) {
+		return;
+	}
+
+	// The helper replaces the memory, so let go of the old mapping first.
+	myMemory.reset();
+
+	auto* arguments = new DynamicObject();
+	arguments->setProperty("sampleRate", sampleRate);
+	arguments->setProperty("blockSize", maximumBlockSize);
+
+	auto reply = request("prepare", arguments);
+
+	if (!(bool)reply["ok"] || !mapMemory(reply["memory"].toString())) {
+		fail();
+		return;
+	}
+
+	myPreparedSampleRate = sampleRate;
+	myPreparedBlockSize = maximumBlockSize;
+	setLatencySamples(reply["latencySamples"]);
+}
+
+void
+SandboxedPlugin::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+	using namespace juce;
+	using namespace SandboxProtocol;
+
+	const int numSamples = buffer.getNumSamples();
+
+	if (hasFailed() || !myMemory || numSamples > getHeader(myMemory->getData())->maximumBlockSize) {
+		buffer.clear();
+		midiMessages.clear();
+		return;
+	}
+
+	void* memory = myMemory->getData();
+	auto* header = getHeader(memory);
+	auto* slot = getSlot(memory, myNextBlock);
+
+	const int numChannels = std::min(buffer.getNumChannels(), (int)header->numChannels);
+
+	slot->numSamples = numSamples;
+	slot->isNonRealtime = isNonRealtime();
+
+	for (int chan = 0; chan < header->numChannels; chan++)
+	{
+		if (chan < numChannels) {
+			FloatVectorOperations::copy(getChannel(memory, slot, chan), buffer.getReadPointer(chan), numSamples);
+		}
+		else {
+			FloatVectorOperations::clear(getChannel(memory, slot, chan), numSamples);
+		}
+	}
+
+	// Changes that don't fit in this slot go with the next block.
+	const int numChanges = std::min((int)myChangedParameters.size(), kMaxParameterChanges);
+
+	for (int i = 0; i < numChanges; i++)
+	{
+		const int index = myChangedParameters[i];
+		slot->parameterChanges[i] = { index, myParameters[index]->getValue() };
+		myParameterIsChanged[index] = 0;
+	}
+
+	slot->numParameterChanges = numChanges;
+	myChangedParameters.erase(myChangedParameters.begin(), myChangedParameters.begin() + numChanges);
+
+	int numEvents = 0;
+
+	for (const auto metadata : midiMessages)
+	{
+		if (numEvents == kMaxMidiEvents) {
+			break;
+		}
+
+		if (metadata.numBytes > (int)sizeof(MidiEvent::data)) {
+			continue;
+		}
+
+		auto& event = slot->midiEvents[numEvents++];
+		event.samplePosition = metadata.samplePosition;
+		event.numBytes = metadata.numBytes;
+		std::memcpy(event.data, metadata.data, (size_t)metadata.numBytes);
+	}
+
+	slot->numMidiEvents = numEvents;
+
+	AudioPlayHead::CurrentPositionInfo position;
+	auto* playHead = getPlayHead();
+
+	slot->hasTransport = playHead && playHead->getCurrentPosition(position);
+
+	if (slot->hasTransport) {
+		auto& transport = slot->transport;
+		transport.bpm = position.bpm;
+		transport.timeInSeconds = position.timeInSeconds;
+		transport.ppqPosition = position.ppqPosition;
+		transport.ppqPositionOfLastBarStart = position.ppqPositionOfLastBarStart;
+		transport.ppqLoopStart = position.ppqLoopStart;
+		transport.ppqLoopEnd = position.ppqLoopEnd;
+		transport.timeInSamples = position.timeInSamples;
+		transport.timeSigNumerator = position.timeSigNumerator;
+		transport.timeSigDenominator = position.timeSigDenominator;
+		transport.isPlaying = position.isPlaying;
+		transport.isLooping = position.isLooping;
+	}
+
+	header->submitted.store(myNextBlock + 1, std::memory_order_release);
+	myConnection->getSubmittedSignal().signal();
+
+	if (!myConnection->getCompletedSignal().waitFor(header->completed, myNextBlock + 1, kBlockTimeoutMs, myConnection->hasLostConnection())) {
+		fail();
+		buffer.clear();
+		midiMessages.clear();
+		return;
+	}
+
+	myNextBlock++;
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		FloatVectorOperations::copy(buffer.getWritePointer(chan), getChannel(memory, slot, chan), numSamples);
+	}
+
+	for (int chan = numChannels; chan < buffer.getNumChannels(); chan++)
+	{
+		buffer.clear(chan, 0, numSamples);
+	}
+
+	midiMessages.clear();
+
+	for (int i = 0; i < slot->numMidiEvents; i++)
+	{
+		const auto& event = slot->midiEvents[i];
+		midiMessages.addEvent(event.data, event.numBytes, event.samplePosition);
+	}
+
+	if (slot->latencySamples != getLatencySamples()) {
+		setLatencySamples(slot->latencySamples);
+	}
+}
+
+void
+SandboxedPlugin::reset()
+{
+	request("reset");
+}
+
+bool
+SandboxedPlugin::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+	return layouts.getMainInputChannels() == myDescription.numInputChannels &&
+		layouts.getMainOutputChannels() == myDescription.numOutputChannels;
+}
+
+bool
+SandboxedPlugin::applyPreset(const juce::MemoryBlock& presetData)
+{
+	auto* arguments = new juce::DynamicObject();
+	arguments->setProperty("data", presetData.toBase64Encoding());
+
+	auto reply = request("preset", arguments);
+
+	if (!(bool)reply["ok"]) {
+		return false;
+	}
+
+	updateParameterValues(reply["values"]);
+	return true;
+}
+
+void
+SandboxedPlugin::getStateInformation(juce::MemoryBlock& destData)
+{
+	auto reply = request("getState");
+
+	destData.reset();
+	destData.fromBase64Encoding(reply["state"].toString());
+}
+
+void
+SandboxedPlugin::setStateInformation(const void* data, int sizeInBytes)
+{
+	auto* arguments = new juce::DynamicObject();
+	arguments->setProperty("state", juce::MemoryBlock(data, (size_t)sizeInBytes).toBase64Encoding());
+
+	updateParameterValues(request("setState", arguments)["values"]);
+}
+
+void
+SandboxedPlugin::fillInPluginDescription(juce::PluginDescription& description) const
+{
+	description = myDescription;
+}
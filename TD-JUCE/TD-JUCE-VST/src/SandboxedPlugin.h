@@ -0,0 +1,117 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "SandboxProtocol.h"
+#include "SandboxSignal.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+class SandboxConnection;
+
+// Stands in for a plugin that runs in a helper process (TD-JUCE-VSTHost), so
+// a plugin that crashes takes down the helper instead of TouchDesigner.
+//
+// To everything else this is an ordinary AudioPluginInstance: its parameters
+// mirror the real plugin's, and processBlock() hands the block to the helper
+// through shared memory and sleeps until it comes back. If the helper dies or
+// stops rendering blocks, the plugin goes silent and hasFailed() turns true.
+// Other requests, like presets and state, that go unanswered just fail on
+// their own. setNonRealtime() goes with the next block rather than as a
+// request, so it never waits on the helper.
+class SandboxedPlugin : public juce::AudioPluginInstance
+{
+public:
+	~SandboxedPlugin() override;
+
+	// Launches a helper and loads the plugin (and the preset, if presetPath isn't
+	// empty) into it. Blocks until the helper has answered, so call it off the
+	// cook thread. Returns nullptr with errorMessage set on failure.
+	static std::unique_ptr<SandboxedPlugin> create(const std::string& pluginPath, const std::string& presetPath,
+		double sampleRate, int blockSize, std::string& errorMessage);
+
+	// True once the helper has crashed, quit or timed out on a block.
+	bool hasFailed() const;
+
+	// Applies FXP or VST3 preset data in the helper. Returns true on success.
+	bool applyPreset(const juce::MemoryBlock& presetData);
+
+	// AudioProcessor
+	const juce::String getName() const override { return myName; }
+
+	void prepareToPlay(double sampleRate, int maximumBlockSize) override;
+	void releaseResources() override {}
+	void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+	void reset() override;
+
+	// Only the layout the helper loaded the plugin with, which can't change.
+	bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
+
+	double getTailLengthSeconds() const override { return myTailLengthSeconds; }
+	bool acceptsMidi() const override { return myAcceptsMidi; }
+	bool producesMidi() const override { return myProducesMidi; }
+
+	juce::AudioProcessorEditor* createEditor() override { return nullptr; }
+	bool hasEditor() const override { return false; }
+
+	int getNumPrograms() override { return 1; }
+	int getCurrentProgram() override { return 0; }
+	void setCurrentProgram(int) override {}
+	const juce::String getProgramName(int) override { return {}; }
+	void changeProgramName(int, const juce::String&) override {}
+
+	void getStateInformation(juce::MemoryBlock& destData) override;
+	void setStateInformation(const void* data, int sizeInBytes) override;
+
+	// AudioPluginInstance
+	void fillInPluginDescription(juce::PluginDescription& description) const override;
+
+private:
+
+	class Parameter;
+
+	SandboxedPlugin(std::unique_ptr<SandboxConnection> connection, const juce::var& description);
+
+	// Sends a request and waits for the reply, or returns a void var on failure.
+	// Only a lost connection fails the plugin; a request that times out fails
+	// on its own, as the helper may just be busy.
+	juce::var request(const juce::String& type, juce::DynamicObject::Ptr arguments = nullptr, int timeoutMs = 5000);
+
+	// Maps the shared memory the helper made. Returns false if it can't.
+	bool mapMemory(const juce::String& path);
+
+	// Takes the parameter values from a reply after a load or preset.
+	void updateParameterValues(const juce::var& values);
+
+	void fail();
+
+	// Called by a Parameter when the host sets it, on the render path.
+	void parameterChanged(int index);
+
+	std::unique_ptr<SandboxConnection> myConnection;
+	std::unique_ptr<juce::MemoryMappedFile> myMemory;
+
+	juce::String myName;
+	juce::PluginDescription myDescription;
+	double myTailLengthSeconds = 0.;
+	bool myAcceptsMidi = false;
+	bool myProducesMidi = false;
+
+	std::vector<Parameter*> myParameters;
+
+	// Parameters set since the last block, each listed once.
+	std::vector<int> myChangedParameters;
+	std::vector<uint8_t> myParameterIsChanged;
+
+	// The block the next processBlock() fills.
+	uint32_t myNextBlock = 0;
+
+	double myPreparedSampleRate = 0.;
+	int myPreparedBlockSize = 0;
+
+	std::atomic<bool> myHasFailed { false };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SandboxedPlugin)
+};
@@ -0,0 +1,53 @@
+#include "SilenceDetector.h"
+
+void
+SilenceDetector::reset()
+{
+	mySilentInputSamples = 0;
+	myOutputIsSilent = false;
+	myIsAsleep = false;
+}
+
+bool
+SilenceDetector::isSilent(const float* const* channels, int numChannels, int numSamples) const
+{
+	using namespace juce;
+
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		auto range = FloatVectorOperations::findMinAndMax(channels[chan], numSamples);
+
+		if (range.getStart() < -myThreshold || range.getEnd() > myThreshold) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool
+SilenceDetector::shouldSleep(bool inputIsSilent, int numSamples, int64_t tailSamples)
+{
+	if (!inputIsSilent) {
+		reset();
+		return false;
+	}
+
+	mySilentInputSamples += numSamples;
+
+	if (!myIsAsleep && myOutputIsSilent && mySilentInputSamples > tailSamples) {
+		myIsAsleep = true;
+	}
+
+	if (myIsAsleep) {
+		mySamplesAsleep += numSamples;
+	}
+
+	return myIsAsleep;
+}
+
+void
+SilenceDetector::outputRendered(const float* const* channels, int numChannels, int numSamples)
+{
+	myOutputIsSilent = isSilent(channels, numChannels, numSamples);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+// Decides when a plugin can stop processing because its input has gone quiet
+// and its output has died away, and keeps count of the time spent asleep.
+//
+// The plugin's reported tail is only a minimum wait, since many plugins
+// report 0 or an infinite tail. It only sleeps once the output it rendered
+// has also dropped below the threshold, and it wakes on the first block with
+// any input or MIDI.
+class SilenceDetector
+{
+public:
+	// Samples at or below gain count as silence.
+	void setThreshold(float gain) { myThreshold = gain; }
+
+	// Wakes up and forgets how long the input has been silent.
+	void reset();
+
+	// True if every channel of the block is within the threshold.
+	bool isSilent(const float* const* channels, int numChannels, int numSamples) const;
+
+	// Called before rendering each block. Returns true if the block can be
+	// skipped, with the plugin's output taken to be silence.
+	bool shouldSleep(bool inputIsSilent, int numSamples, int64_t tailSamples);
+
+	// Called with the output of each block the plugin did render.
+	void outputRendered(const float* const* channels, int numChannels, int numSamples);
+
+	bool isAsleep() const { return myIsAsleep; }
+
+	int64_t getSamplesAsleep() const { return mySamplesAsleep; }
+
+private:
+
+	float myThreshold = 0.f;
+
+	int64_t mySilentInputSamples = 0;
+	bool myOutputIsSilent = false;
+	bool myIsAsleep = false;
+
+	int64_t mySamplesAsleep = 0;
+};
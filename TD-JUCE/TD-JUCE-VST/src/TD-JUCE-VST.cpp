@@ -19,6 +19,7 @@
 #include <cmath>
 #include <assert.h>
 #include <algorithm>
+#include <limits>
 #include <filesystem>
 
 // These functions are basic C function, which the DLL loader can find
@@ -49,7 +50,7 @@ extern "C"
 		info->customOPInfo.authorEmail->setString("github.com/dbraun");
 
 		info->customOPInfo.minInputs = 0;
-		info->customOPInfo.maxInputs = 3;  // input audio, parameters, and MIDI notes
+		info->customOPInfo.maxInputs = 4;  // input audio, parameters, MIDI notes and sidechain audio
 	}
 
 	DLLEXPORT
@@ -74,18 +75,33 @@ extern "C"
 };
 
 
-TDVST::TDVST(const OP_NodeInfo* info) : myNodeInfo(info), mySampleRate(0.)
+// Renders one instance on the thread pool. It's added to the pool again every
+// cook, so it never deletes itself.
+class TDVST::InstanceJob : public juce::ThreadPoolJob
 {
-	myExecuteCount = 0;
-
-	myBuffer.setSize(2, 1024);
-	myBufferSecondary.setSize(2, 0);
+public:
+	InstanceJob(TDVST& owner, int instance) : juce::ThreadPoolJob("TD-JUCE-VST instance"), myOwner(owner), myInstance(instance)
+	{
+	}
 
-	for (size_t i = 0; i < 128; i++)
+	JobStatus runJob() override
 	{
-		myActiveNotes[i] = 0;
+		myOwner.renderInstance(myInstance);
+		return jobHasFinished;
 	}
 
+private:
+	TDVST& myOwner;
+	const int myInstance;
+};
+
+TDVST::TDVST(const OP_NodeInfo* info) : myNodeInfo(info), mySampleRate(0.), myRenderer(std::make_unique<PluginRenderer>()), myPipeline(*this)
+{
+	myExecuteCount = 0;
+
+	// Plugins are created and destroyed on this thread.
+	PluginLoader::ensureMessageThread();
+
 	myCurrentPositionInfo.resetToDefault();
 
 	myCurrentPositionInfo.isPlaying = true;
@@ -104,20 +120,25 @@ TDVST::TDVST(const OP_NodeInfo* info) : myNodeInfo(info), mySampleRate(0.)
 
 TDVST::~TDVST()
 {
+	myPipeline.stop();
 	shutdownPlugin();
 }
 
 void
 TDVST::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* inputs, void* reserved1)
 {
-	// This will cause the node to cook every frame
-	ginfo->cookEveryFrameIfAsked = true;
+	// An offline render only cooks when its inputs change, and outputs all of them at once.
+	const bool offlineRender = inputs->getParInt("Offlinerender") != 0;
+
+	// This will cause the node to cook every frame. An offline render keeps
+	// cooking while a plugin loads, since nothing else would cook it once it's ready.
+	ginfo->cookEveryFrameIfAsked = !offlineRender || isPluginPending(inputs);
 
 	// Note: To disable timeslicing you'll need to turn this off, as well as ensure that
 	// getOutputInfo() returns true, and likely also set the info->numSamples to how many
 	// samples you want to generate for this CHOP. Otherwise it'll take on length of the
 	// input CHOP, which may be timesliced.
-	ginfo->timeslice = true;
+	ginfo->timeslice = !offlineRender;
 
 	ginfo->inputMatchIndex = 0;
 }
@@ -125,6 +146,8 @@ TDVST::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* inputs, void* re
 void
 TDVST::updatePosInfo(const OP_TimeInfo* timeInfo) {
 	// todo(DBraun) is there a way to set this automatically from TouchDesigner's BPM and time signature?
+	const juce::SpinLock::ScopedLockType sl(myPositionLock);
+
 	myCurrentPositionInfo.bpm = 120.;
 	myCurrentPositionInfo.timeSigNumerator = 4;
 	myCurrentPositionInfo.timeSigDenominator = 4;
@@ -148,443 +171,2574 @@ TDVST::getOutputInfo(CHOP_OutputInfo* info, const OP_Inputs* inputs, void* reser
 		newSampleRate = inputs->getParDouble("Samplerate");
 	}
 
-	double newRate = timeInfo->rate;
+	// The plugin gets prepared for the new rate in execute(), and only if it changed.
+	mySampleRate = newSampleRate;
 
-	if (newSampleRate != mySampleRate || myCookRate != newRate) {
-		mySampleRate = newSampleRate;
-		myCookRate = newRate;
-		
-		int bufferSize = (int) ((mySampleRate-1)/ newRate) + 1;
+	// Done here so the output has the new layout's channels in this cook.
+	applyBusLayout(inputs);
 
-		if (myPlugin) {
-			myPlugin->prepareToPlay(newSampleRate, bufferSize);
-		}
-		
+	auto plugin = myRenderer->getPlugin();
+	const int numInstances = myNumInstances;
+
+	// The channel count is set whether or not an input is connected, and this
+	// always returns true, so TouchDesigner never falls back to the input's layout.
+	if (numInstances > 1) {
+		// A pair of channels per instance, however many channels the input has.
+		info->numChannels = 2 * numInstances;
+	}
+	else if (plugin) {
+		// Every channel of every output bus the plugin has enabled.
+		info->numChannels = std::max(2, plugin->getTotalNumOutputChannels());
 	}
 	else {
-		mySampleRate = newSampleRate;
-		myCookRate = newRate;
+		info->numChannels = inputAudioCHOP ? inputAudioCHOP->numChannels : 2;
 	}
 
-	info->numChannels = 2;
-
 	if (inputAudioCHOP) {
-		return false;
+		info->numSamples = inputAudioCHOP->numSamples;
+		info->startIndex = (uint32_t) inputAudioCHOP->startIndex;
+		info->sampleRate = (float) inputAudioCHOP->sampleRate;
 	}
 	else {
-		info->numSamples = (int32_t) (mySampleRate* timeInfo->deltaMS / 1000);
-		info->numChannels = 2;
+		if (inputs->getParInt("Offlinerender")) {
+			info->numSamples = std::max(1, (int32_t) (mySampleRate * inputs->getParDouble("Offlinelength")));
+		}
+		else {
+			info->numSamples = (int32_t) (mySampleRate* timeInfo->deltaMS / 1000);
+		}
 		info->sampleRate = (float) mySampleRate;
-
-		return true;
 	}
+
+	return true;
 }
 
 void
 TDVST::getChannelName(int32_t index, OP_String* name, const OP_Inputs* inputs, void* reserved1)
 {
 	std::stringstream ss;
+
+	auto plugin = myRenderer->getPlugin();
+
+	// The main bus keeps the plain names. Other buses are named after the bus,
+	// e.g. aux1_2 for the second channel of "Aux 1".
+	int firstChannel = plugin ? plugin->getChannelCountOfBus(false, 0) : 0;
+
+	for (int bus = 1; plugin && myInstances.empty() && bus < plugin->getBusCount(false); bus++)
+	{
+		const int numChannels = plugin->getChannelCountOfBus(false, bus);
+
+		if (index >= firstChannel && index < firstChannel + numChannels) {
+			std::string busName;
+
+			for (const char c : plugin->getBus(false, bus)->getName().toLowerCase().toStdString())
+			{
+				if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+					busName += c;
+				}
+			}
+
+			if (busName.empty()) {
+				busName = "bus" + std::to_string(bus);
+			}
+
+			ss << busName << "_" << (index - firstChannel + 1);
+			name->setString(ss.str().c_str());
+			return;
+		}
+
+		firstChannel += numChannels;
+	}
+
 	ss << "chan" << (index + 1);
 	name->setString(ss.str().c_str());
 }
 
-
-// Returns true if the preset was loaded successfully. False otherwise.
-bool
-TDVST::loadPreset(const std::string& path)
+void
+TDVST::applyBusLayout(const OP_Inputs* inputs)
 {
-	using namespace juce;
+	// Extra instances each render a pair of channels, so they keep their main buses.
+	const bool allBuses = inputs->getParInt("Allbuses") != 0 && inputs->getParInt("Instances") == 1;
+	const int mainBusChannels = inputs->getParInt("Mainbuschannels");
 
-	if (!std::filesystem::exists(path)) {
-		return false;
+	// The helper loads a sandboxed plugin with its default buses, which it keeps.
+	if (myRenderer->hasBusLayout(allBuses, mainBusChannels) || dynamic_cast<SandboxedPlugin*>(myRenderer->getPlugin())) {
+		return;
 	}
 
-	try {
-		MemoryBlock mb;
-		File file = File(path);
-		file.loadFileAsData(mb);
+	const juce::ScopedLock sl(myPipeline.getRenderLock());
 
-#if JUCE_PLUGINHOST_VST
-		// The VST2 way of loading preset. You need the entire VST2 SDK source, which is not public.
-		VSTPluginFormat::loadFromFXBFile(myPlugin.get(), mb.getData(), mb.getSize());
+	myRenderer->setBusLayout(allBuses, mainBusChannels);
+	myRenderCache.clear();
+}
 
-#else
+int
+TDVST::getNumPluginInputChannels(int* numMainChannels) const
+{
+	auto plugin = myRenderer->getPlugin();
 
-		setVST3PluginStateDirect(myPlugin.get(), mb);
+	const int numMainBusChannels = plugin && plugin->getBusCount(true) > 0 ? plugin->getChannelCountOfBus(true, 0) : 0;
+	const int numOtherChannels = plugin ? plugin->getTotalNumInputChannels() - numMainBusChannels : 0;
 
-#endif
+	// At least stereo on the main bus, as that's what the renderer's buffer has.
+	// Other buses follow the main one in the buffer, so with any of those the
+	// main bus keeps its own width, or a sidechain would land a channel late.
+	const int numMain = numOtherChannels > 0 ? numMainBusChannels : std::max(2, numMainBusChannels);
 
-		return true;
-	}
-	catch (std::exception& e) {
-		std::cout << "TDVST::loadPreset " << e.what() << std::endl;
-		return false;
+	if (numMainChannels) {
+		*numMainChannels = numMain;
 	}
 
+	return numMain + numOtherChannels;
 }
 
-void
-TDVST::saveParameterInfo() {
+int
+TDVST::gatherInputChannels(const OP_CHOPInput* inputCHOP, const OP_CHOPInput* sidechainCHOP, int startSample, int numSamples)
+{
+	if (!inputCHOP && !sidechainCHOP) {
+		return 0;
+	}
 
-	using namespace juce;
+	int numMainChannels = 0;
+	const int numChannels = getNumPluginInputChannels(&numMainChannels);
 
-	myParameterMap.clear();
+	myInputChannelPointers.resize(numChannels);
+
+	// The main bus reads the first input and the other buses read the fourth,
+	// each repeating its last channel if it has too few, so a mono input feeds
+	// both sides of a stereo plugin.
+	for (int chan = 0; chan < numChannels; chan++)
+	{
+		const bool isMain = chan < numMainChannels;
+		const auto source = isMain ? inputCHOP : sidechainCHOP;
+		const int sourceChannel = isMain ? chan : chan - numMainChannels;
 
-	for (int i = 0; i < myPlugin->AudioProcessor::getNumParameters(); i++) {
+		// The fourth input can be a different length from the first.
+		const int numAvailable = source && source->numChannels > 0 ? source->numSamples - startSample : 0;
 
-		int maximumStringLength = 64;
+		if (numAvailable <= 0) {
+			myInputChannelPointers[chan] = mySilentChannel.data();
+			continue;
+		}
 
-		auto theName = myPlugin->getParameterName(i).toStdString();
-		//std::string currentText = processorParams[i]->getText(processorParams[i]->getValue(), maximumStringLength).toStdString();
-		//std::string label = processorParams[i]->getLabel().toStdString();
+		const float* sourceData = source->getChannelData(std::min(sourceChannel, source->numChannels - 1)) + startSample;
 
-		myParameterMap[i] = std::make_pair(theName, myPlugin->getParameter(i));
+		if (numAvailable >= numSamples) {
+			myInputChannelPointers[chan] = sourceData;
+			continue;
+		}
 
-		//py::dict myDictionary;
-		//myDictionary["index"] = i;
-		//myDictionary["name"] = theName;
-		//myDictionary["numSteps"] = processorParams[i]->getNumSteps();
-		//myDictionary["isDiscrete"] = processorParams[i]->isDiscrete();
-		//myDictionary["label"] = label;
-		//myDictionary["text"] = currentText;
+		if (myPaddedInputBuffer.getNumChannels() < numChannels || myPaddedInputBuffer.getNumSamples() < numSamples) {
+			myPaddedInputBuffer.setSize(numChannels, numSamples, false, false, true);
+		}
 
-		//myList.append(myDictionary);
+		float* padded = myPaddedInputBuffer.getWritePointer(chan);
+		juce::FloatVectorOperations::copy(padded, sourceData, numAvailable);
+		juce::FloatVectorOperations::clear(padded + numAvailable, numSamples - numAvailable);
+		myInputChannelPointers[chan] = padded;
 	}
+
+	return numChannels;
 }
 
-bool
-TDVST::checkPlugin(const char* pluginFilepath) {
+
+void
+TDVST::saveParameterInfo() {
 
 	using namespace juce;
 
-	if (emptyString.compare(pluginFilepath) == 0) {
-		return false;
+	myParameterInfo.clear();
+	myParameterValues.clear();
+	myParameterValuesAreStale = true;
+	myQueuedParameterValues.clear();
+	myMorph.setParameters({});
+
+	auto plugin = myRenderer->getPlugin();
+
+	if (!plugin) {
+		return;
 	}
 
-	if (myPluginPath.compare(pluginFilepath) != 0) {
+	const int maximumStringLength = 64;
 
-		if (!std::filesystem::exists(pluginFilepath)) {
-			return false;
-		}
+	auto& parameters = plugin->getParameters();
 
-		juce::OwnedArray<PluginDescription> pluginDescriptions;
-		KnownPluginList pluginList;
-		AudioPluginFormatManager pluginFormatManager;
+	myParameterInfo.reserve(parameters.size());
 
-		pluginFormatManager.addDefaultFormats();
+	for (auto parameter : parameters) {
+		myParameterInfo.push_back({
+			parameter->getName(maximumStringLength).toStdString(),
+			parameter->getLabel().toStdString(),
+			parameter->getNumSteps(),
+			parameter->isDiscrete(),
+			parameter->getText(0.f, maximumStringLength).toStdString(),
+			parameter->getText(1.f, maximumStringLength).toStdString(),
+			parameter->getDefaultValue()
+		});
+	}
 
-		for (int i = pluginFormatManager.getNumFormats(); --i >= 0;)
-		{
-			pluginList.scanAndAddFile(String(pluginFilepath),
-				true,
-				pluginDescriptions,
-				*pluginFormatManager.getFormat(i));
-		}
+	myParameterValues.resize(myParameterInfo.size());
+	myQueuedParameterValues.assign(myParameterInfo.size(), std::numeric_limits<float>::quiet_NaN());
+
+	std::vector<bool> isDiscrete;
 
-		// If there is a problem here first check the preprocessor definitions
-		// in the projucer are sensible - is it set up to scan for plugin's?
-		jassert(pluginDescriptions.size() > 0);
+	for (const auto& info : myParameterInfo)
+	{
+		isDiscrete.push_back(info.isDiscrete);
+	}
 
-		String errorMessage;
+	myMorph.setParameters(isDiscrete);
+	myMorphValues.resize(myParameterInfo.size());
+}
 
-		shutdownPlugin();
+void
+TDVST::refreshParameterValues() {
+
+	if (!myParameterValuesAreStale) {
+		return;
+	}
 
-		myPlugin = pluginFormatManager.createPluginInstance(*pluginDescriptions[0],
-			mySampleRate,
-			mySamplesPerBlock,
-			errorMessage);
+	if (auto plugin = myRenderer->getPlugin()) {
+		auto& parameters = plugin->getParameters();
 
-		if (myPlugin != nullptr)
+		for (int i = 0; i < std::min((int)myParameterValues.size(), parameters.size()); i++)
 		{
-			//std::cout << "TDVST::loadPlugin success!" << std::endl;
+			myParameterValues[i] = parameters.getUnchecked(i)->getValue();
+		}
+	}
+
+	myParameterValuesAreStale = false;
+}
+
+bool
+TDVST::isPluginPending(const OP_Inputs* inputs) const {
+	return myLoader.isLoadingPlugin() ||
+		myPluginPath.compare(inputs->getParFilePath("Vstfile")) != 0 ||
+		inputs->getParInt("Instances") != myRequestedNumInstances ||
+		(inputs->getParInt("Sandbox") != 0) != myRequestedSandboxed;
+}
 
-			saveParameterInfo();
+void
+TDVST::checkPlugin(const char* pluginFilepath, const char* presetFilepath, int numInstances, bool sandboxed) {
 
-			myPlugin->setPlayHead(this);
-			myPlugin->prepareToPlay(mySampleRate, 1024);
-			
-			myPlugin->setNonRealtime(false);  // todo: allow non-realtime render if TouchDesigner is set to non-realtime?
+	if (myPluginPath.compare(pluginFilepath) == 0 && numInstances == myRequestedNumInstances && sandboxed == myRequestedSandboxed) {
+		return;
+	}
 
-			myPluginPath = pluginFilepath;
-			return true;
-		}
+	myPluginPath = pluginFilepath;
+	myRequestedNumInstances = numInstances;
+	myRequestedSandboxed = sandboxed;
 
-		std::cout << "TDVST::loadPlugin error: " << errorMessage.toStdString() << std::endl;
-		return false;
+	if (emptyString.compare(pluginFilepath) == 0) {
+		shutdownPlugin();
+		myNumInstances = numInstances;
+		mySandboxed = sandboxed;
+		myLoadError.clear();
+		return;
 	}
 
-	return true;
+	// The first plugin gets the FXP file applied as part of loading.
+	myLoader.loadPlugin(myPluginPath, myDoLoadPreset ? presetFilepath : emptyString,
+		mySampleRate, mySamplesPerBlock, this, numInstances, sandboxed);
+	myDoLoadPreset = false;
 }
 
 void
-TDVST::execute(CHOP_Output* output,
-	const OP_Inputs* inputs,
-	void* reserved)
-{
+TDVST::swapInLoadedRenderer(const OP_Inputs* inputs) {
+
 	using namespace juce;
 
-	myExecuteCount++;
+	std::vector<std::unique_ptr<PluginRenderer>> instances;
+	auto renderer = myLoader.takeLoadedRenderer(myLoadError, &instances);
 
-	if (!checkPlugin(inputs->getParFilePath("Vstfile"))) return;
+	if (!renderer) {
+		return;
+	}
 
-	auto inputCHOP = inputs->getInputCHOP(0);
+	// The path was cleared while this was loading, or the load failed, in
+	// which case the plugin that's playing keeps playing and myLoadError says why.
+	if (myPluginPath.empty() || !renderer->getPlugin()) {
+		myLoader.retire(std::move(renderer));
+		for (auto& instance : instances)
+		{
+			myLoader.retire(std::move(instance));
+		}
+		if (myPluginPath.empty()) {
+			myLoadError.clear();
+		}
+		return;
+	}
 
-	auto vstParameterCHOP = inputs->getInputCHOP(1);
+	const double crossfadeSeconds = inputs->getParDouble("Crossfade");
 
-	auto midiCHOP = inputs->getInputCHOP(2);
+	const ScopedLock sl(myPipeline.getRenderLock());
 
-	if (myDoLoadPreset) {
-		loadPreset(inputs->getParFilePath("Fxpfile"));
-		myDoLoadPreset = false;
+	for (auto& instance : myInstances)
+	{
+		myLoader.retire(std::move(instance));
+	}
+	myInstances = std::move(instances);
+
+	// Only a single instance crossfades.
+	if (crossfadeSeconds > 0. && myInstances.empty() && myRenderer->getPlugin() && renderer->getPlugin()) {
+		// If a previous crossfade is still going, its outgoing plugin is cut off.
+		myLoader.retire(std::move(myFadingRenderer));
+		myFadingRenderer = std::move(myRenderer);
+		myCrossfadeLength = std::max(1, roundToInt(crossfadeSeconds * mySampleRate));
+		myCrossfadeRemaining = myCrossfadeLength;
+	}
+	else {
+		myLoader.retire(std::move(myRenderer));
 	}
 
-	int newSamplesPerBlock = inputs->getParInt("Blocksize");
-
-	if (newSamplesPerBlock != mySamplesPerBlock) {
+	myRenderer = std::move(renderer);
+	myNumInstances = myRequestedNumInstances;
+	mySandboxed = myRequestedSandboxed;
+	saveParameterInfo();
 
-		myPlugin->prepareToPlay(mySampleRate, newSamplesPerBlock);
+	myRenderer->setTimings(&myTimings);
+	for (auto& instance : myInstances)
+	{
+		instance->setTimings(&myTimings);
 	}
-	mySamplesPerBlock = newSamplesPerBlock;
 
-	myBuffer.setSize(2, mySamplesPerBlock, false, false, false); // todo: dangerous to hard-code stereo output
-	myBufferSecondary.setSize(2, output->numSamples % mySamplesPerBlock, false, false, false);
-	
-	myRenderMidiBuffer.clear();
+	// The new plugin has none of the bank's state yet.
+	myAppliedBankPreset = -1;
+	mySilenceDetector.reset();
+	myRenderCache.clear();
+
+	const size_t numInstances = myInstances.size() + 1;
+	myInstanceScanners.resize(numInstances);
+	myInstanceParameterUpdates.resize(numInstances);
 
-	// i is the "block index"
-	for (size_t i = 0; i < ((output->numSamples-1) / mySamplesPerBlock)+1; i++)
+	while (myInstanceJobs.size() < numInstances)
 	{
+		myInstanceJobs.push_back(std::make_unique<InstanceJob>(*this, (int)myInstanceJobs.size()));
+	}
 
-		if (vstParameterCHOP && i*mySamplesPerBlock < vstParameterCHOP->numSamples) {
-			for (size_t chan = 0; chan < std::min(vstParameterCHOP->numChannels, (int32_t) myPlugin->getNumParameters()); chan++)
-			{
-				myPlugin->setParameter((int)chan, vstParameterCHOP->getChannelData((int32_t)chan)[i*mySamplesPerBlock]);
-			}
-		}
+	if (numInstances > 1 && !myInstancePool) {
+		myInstancePool = std::make_unique<ThreadPool>();
+	}
+}
 
-		if (midiCHOP) {
+void
+TDVST::applyMorph(const OP_Inputs* inputs, const OP_CHOPInput* parameterCHOP, bool backgroundRender, int64_t time)
+{
+	using namespace juce;
 
-			int maxSamp = std::min(((int)i + 1) * mySamplesPerBlock, (int)output->numSamples);
-			maxSamp = std::min(maxSamp, midiCHOP->numSamples);
+	if (myDoCaptureSnapshot) {
+		myDoCaptureSnapshot = false;
 
-			for (int note = 0; note < std::min(128, midiCHOP->numChannels); note++)
-			{
-				for (size_t samp = i * mySamplesPerBlock; samp < maxSamp; samp++)
-				{
-					float velocity = midiCHOP->getChannelData((int32_t)note)[(int)samp];
-					velocity = std::min(1.f, std::max(0.f, velocity));  // clamp 0 to 1
-					bool isOn = (bool)velocity;
-					if ((bool)velocity != myActiveNotes[note]) {
+		// Read the plugin's values now, not whenever the Info DAT last did.
+		myParameterValuesAreStale = true;
+		refreshParameterValues();
+		myMorph.capture(inputs->getParInt("Snapshotslot"), myParameterValues.data());
+	}
 
-						juce::MidiMessage myMidiMessage = isOn ? juce::MidiMessage::noteOn(1, note, velocity) : juce::MidiMessage::noteOff(1, note, velocity);
+	enum { Off, Linear, XY };
 
-						myRenderMidiBuffer.addEvent(myMidiMessage, (int)( samp - i * mySamplesPerBlock));
-						myActiveNotes[note] = isOn;
+	const int mode = inputs->getParInt("Morphmode");
 
-						//std::cout << "note: " << note << " vel: " << velocity << " samp: " << samp - i * mySamplesPerBlock << std::endl;
-					}
-				}
-			}
-		}
+	if (mode == Off || myMorph.getNumParameters() == 0) {
+		return;
+	}
 
-		int bufferSize = std::min(mySamplesPerBlock, (int)(output->numSamples - (i * mySamplesPerBlock)));
-		myPlugin->prepareToPlay(mySampleRate, bufferSize);
-		auto& theBuffer = bufferSize == mySamplesPerBlock ? myBuffer : myBufferSecondary;
+	float* values = myMorphValues.data();
 
-		if (inputCHOP) {
+	const float x = (float)inputs->getParDouble("Morph", 0);
+	const float y = (float)inputs->getParDouble("Morph", 1);
 
-			//myBuffer->setDataToReferTo((float**)inputCHOP->channelData, 2, bufferSize);  // todo: dangerous to hard-code stereo input
-			for (int chan = 0; chan < 2; chan++)
-			{
-				theBuffer.copyFrom(chan, 0, (const float*)(inputCHOP->getChannelData(std::min((int)chan, inputCHOP->numChannels)) + (i*mySamplesPerBlock)), bufferSize);
-			}
-		}
+	const bool isMorphing = mode == Linear ? myMorph.morphLinear(x, inputs->getParInt("Morphslots"), values) : myMorph.morphXY(x, y, values);
+
+	if (!isMorphing) {
+		return;
+	}
 
-		myPlugin->processBlock(theBuffer, myRenderMidiBuffer);
+	const int numValues = myMorph.getNumParameters();
 
-		// increment the position
-		myCurrentPositionInfo.timeInSamples += theBuffer.getNumSamples();
-		myCurrentPositionInfo.ppqPosition = (myCurrentPositionInfo.timeInSamples / (mySampleRate * 60.)) * myCurrentPositionInfo.bpm;
+	if (backgroundRender) {
+		const int firstValue = parameterCHOP ? std::min(parameterCHOP->numChannels, numValues) : 0;
 
-		for (int chan = 0; chan < output->numChannels; chan++) {
-			auto chanPtr = theBuffer.getReadPointer(chan);
-			for (int samp = (int) i * mySamplesPerBlock; samp < std::min(((int)i + 1) * mySamplesPerBlock, (int)output->numSamples); samp++)
-			{
-				output->channels[chan][samp] = *chanPtr++;
+		for (int i = firstValue; i < numValues; i++)
+		{
+			if (values[i] != myQueuedParameterValues[i] && myPipeline.pushParameter(time, i, values[i])) {
+				myQueuedParameterValues[i] = values[i];
+				myParameterUpdateCount++;
 			}
 		}
+		return;
 	}
 
-	// TODO: only write to the map if the user requests it with a toggle custom parameter.
-	for (int i = 0; i < myPlugin->getNumParameters(); i++)
+	// Each instance reads its own slice of the parameter CHOP, so it's that many channels that are skipped.
+	const int numInstances = (int)myInstances.size() + 1;
+	const int numChannels = parameterCHOP ? (myInstances.empty() ? parameterCHOP->numChannels : parameterCHOP->numChannels / numInstances) : 0;
+
+	for (int instance = 0; instance < numInstances; instance++)
 	{
-		myParameterMap[i] = std::make_pair(myPlugin->getParameterName(i).toStdString(), myPlugin->getParameter(i));
-	}
-	
-}
+		auto& renderer = instance == 0 ? *myRenderer : *myInstances[instance - 1];
+		const int firstValue = std::min(numChannels, renderer.getNumParameters());
+		const int numMorphValues = std::min(numValues, renderer.getNumParameters()) - firstValue;
 
-int32_t
-TDVST::getNumInfoCHOPChans(void* reserved1)
-{
-	// We return the number of channel we want to output to any Info CHOP
-	// connected to the CHOP. In this example we are just going to send one channel.
-	return 1;
+		if (numMorphValues <= 0) {
+			continue;
+		}
+
+		FloatVectorOperations::copy(renderer.getPendingParameterValues() + firstValue, values + firstValue, numMorphValues);
+		myParameterUpdateCount += renderer.pushParameters(numMorphValues, firstValue);
+	}
 }
 
 void
-TDVST::getInfoCHOPChan(int32_t index,
-	OP_InfoCHOPChan* chan,
-	void* reserved1)
+TDVST::checkPresetBank(const OP_Inputs* inputs)
 {
-	// This function will be called once for each channel we said we'd want to return
-	// In this example it'll only be called once.
+	const char* folder = inputs->getParFilePath("Presetfolder");
+	const OP_DATInput* presetDAT = inputs->getParDAT("Presetdat");
 
-	if (index == 0)
-	{
-		chan->name->setString("executeCount");
-		chan->value = (float)myExecuteCount;
+	const uint32_t datId = presetDAT ? presetDAT->opId : 0;
+	const int64_t datCooks = presetDAT ? presetDAT->totalCooks : -1;
+
+	if (myPresetFolder == folder && myPresetDATId == datId && myPresetDATCooks == datCooks) {
+		return;
 	}
-}
 
-bool
-TDVST::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
-{
-	infoSize->rows = (int32_t) myParameterMap.size();
-	infoSize->cols = 2;
-	// Setting this to false means we'll be assigning values to the table
-	// one row at a time. True means we'll do it one column at a time.
-	infoSize->byColumn = false;
-	return true;
-}
+	myPresetFolder = folder;
+	myPresetDATId = datId;
+	myPresetDATCooks = datCooks;
 
-void
-TDVST::getInfoDATEntries(int32_t index,
-	int32_t nEntries,
-	OP_InfoDATEntries* entries,
-	void* reserved1)
-{
-	char tempBuffer[64];
+	// The DAT's files come first, one per row, then the folder's.
+	std::vector<std::string> paths;
 
-	entries->values[0]->setString(myParameterMap[index].first.c_str());
+	if (presetDAT) {
+		for (int row = 0; row < presetDAT->numRows; row++)
+		{
+			paths.push_back(presetDAT->getCell(row, 0));
+		}
+	}
 
-	// Set the value for the second column
-#ifdef _WIN32
-	sprintf_s(tempBuffer, "%f", myParameterMap[index].second);
-#else // macOS
-	snprintf(tempBuffer, sizeof(tempBuffer), "%f", myParameterMap[index].second);
-#endif
-	entries->values[1]->setString(tempBuffer);
+	paths.push_back(myPresetFolder);
+
+	if (paths == myPresetBankPaths) {
+		return;
+	}
+
+	myPresetBankPaths = paths;
+	myLoader.loadPresetBank(paths);
 }
 
 void
-TDVST::setupParameters(OP_ParameterManager* manager, void* reserved1)
+TDVST::selectBankPreset(const OP_Inputs* inputs)
 {
+	using namespace juce;
 
-	// VST File Path
-	{
-		OP_StringParameter sp;
+	if (myLoader.hasLoadedPresetBank()) {
+		// The applied preset is kept aside, so that a bank with the same one at
+		// the same index doesn't apply it again over the plugin's live state.
+		MemoryBlock appliedPreset;
 
-		sp.name = "Vstfile";
-		sp.label = "VST File";
-		sp.defaultValue = "";
+		if (myAppliedBankPreset >= 0 && myAppliedBankPreset < (int)myPresetBank.size()) {
+			appliedPreset.swapWith(myPresetBank[myAppliedBankPreset]);
+		}
 
-		OP_ParAppendResult res = manager->appendFile(sp);
-		assert(res == OP_ParAppendResult::Success);
+		myLoader.takeLoadedPresetBank(myPresetBank);
+
+		if (myAppliedBankPreset >= (int)myPresetBank.size() ||
+			(myAppliedBankPreset >= 0 && myPresetBank[myAppliedBankPreset] != appliedPreset)) {
+			myAppliedBankPreset = -1;
+		}
 	}
 
-	// FXP File Path
-	{
-		OP_StringParameter sp;
+	auto plugin = myRenderer->getPlugin();
 
-		sp.name = "Fxpfile";
-		sp.label = "FXP File";
-		sp.defaultValue = "";
+	if (!plugin || myPresetBank.empty()) {
+		return;
+	}
 
-		OP_ParAppendResult res = manager->appendFile(sp);
-		assert(res == OP_ParAppendResult::Success);
+	const int index = jlimit(0, (int)myPresetBank.size() - 1, (int)inputs->getParInt("Presetindex"));
+
+	if (index == myAppliedBankPreset) {
+		return;
 	}
 
-	//// Freeze Mode
-	//{
-	//	OP_NumericParameter	np;
+	myAppliedBankPreset = index;
 
-	//	np.name = "Freeze";
-	//	np.label = "Freeze";
-	//	np.defaultValues[0] = 0;
+	const auto& presetData = myPresetBank[index];
 
-	//	OP_ParAppendResult res = manager->appendToggle(np);
-	//	assert(res == OP_ParAppendResult::Success);
-	//}
+	if (presetData.getSize() == 0) {
+		return;
+	}
 
-	//// shape
-	//{
-	//	OP_StringParameter	sp;
+	// The state is already in memory, so this only waits on the plugin itself.
+	const ScopedLock sl(myPipeline.getRenderLock());
 
-	//	sp.name = "Shape";
-	//	sp.label = "Shape";
+	for (auto& instance : myInstances)
+	{
+		if (instance->getPlugin() && PluginLoader::applyPreset(instance->getPlugin(), presetData)) {
+			instance->invalidateParameterCache();
+		}
+	}
 
-	//	sp.defaultValue = "Sine";
+	if (PluginLoader::applyPreset(plugin, presetData)) {
+		myRenderer->invalidateParameterCache();
+		myRenderCache.clear();
+		std::fill(myQueuedParameterValues.begin(), myQueuedParameterValues.end(), std::numeric_limits<float>::quiet_NaN());
+	}
+}
 
-	//	const char* names[] = { "Sine", "Square", "Ramp" };
-	//	const char* labels[] = { "Sine", "Square", "Ramp" };
+void
+TDVST::renderBuffered(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples) {
 
-	//	OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
-	//	assert(res == OP_ParAppendResult::Success);
-	//}
+	using namespace juce;
 
-	// pulse
+	auto& buffer = myRenderer->getBlockBuffer(numSamples);
+
+	// Channels with no input are cleared, so an instrument or an unconnected
+	// sidechain doesn't see the previous block's output.
+	for (int chan = 0; chan < buffer.getNumChannels(); chan++)
 	{
-		OP_NumericParameter	np;
+		if (input && chan < numInputChannels) {
+			buffer.copyFrom(chan, 0, input[chan], numSamples);
+		}
+		else {
+			buffer.clear(chan, 0, numSamples);
+		}
+	}
 
-		np.name = "Loadfxp";
-		np.label = "Load FXP";
+	myRenderer->process(buffer);
 
-		OP_ParAppendResult res = manager->appendPulse(np);
-		assert(res == OP_ParAppendResult::Success);
+	for (int chan = 0; chan < numOutputChannels; chan++)
+	{
+		if (chan < buffer.getNumChannels()) {
+			FloatVectorOperations::copy(output[chan], buffer.getReadPointer(chan), numSamples);
+		}
+		else {
+			FloatVectorOperations::clear(output[chan], numSamples);
+		}
 	}
+}
 
-	// Width
-	{
-		OP_NumericParameter	np;
+void
+TDVST::renderCrossfade(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples,
+	double sampleRate, int blockSize) {
 
-		np.name = "Samplerate";
-		np.label = "Sample Rate";
-		np.minValues[0] = 1;
-		np.maxValues[0] = 96000;
-		np.minSliders[0] = 1;
-		np.maxSliders[0] = 96000;
+	using namespace juce;
+
+	myFadingRenderer->prepare(sampleRate, blockSize);
+
+	auto& buffer = myFadingRenderer->getBlockBuffer(numSamples);
+
+	for (int chan = 0; chan < buffer.getNumChannels(); chan++)
+	{
+		if (input && chan < numInputChannels) {
+			buffer.copyFrom(chan, 0, input[chan], numSamples);
+		}
+		else {
+			buffer.clear(chan, 0, numSamples);
+		}
+	}
+
+	// The outgoing plugin hears the same notes as the new one.
+	auto& midiBuffer = myFadingRenderer->getMidiBuffer();
+	midiBuffer.clear();
+	midiBuffer.addEvents(myRenderer->getMidiBuffer(), 0, -1, 0);
+
+	myFadingRenderer->process(buffer);
+
+	const int numFadeSamples = std::min(numSamples, myCrossfadeRemaining);
+	const int fadePosition = myCrossfadeLength - myCrossfadeRemaining;
+
+	for (int chan = 0; chan < std::min(numOutputChannels, buffer.getNumChannels()); chan++)
+	{
+		float* newSamples = output[chan];
+		const float* oldSamples = buffer.getReadPointer(chan);
+
+		for (int samp = 0; samp < numFadeSamples; samp++)
+		{
+			const float gain = (float)(fadePosition + samp) / (float)myCrossfadeLength;
+			newSamples[samp] = newSamples[samp] * gain + oldSamples[samp] * (1.f - gain);
+		}
+	}
+
+	myCrossfadeRemaining -= numFadeSamples;
+
+	if (myCrossfadeRemaining <= 0) {
+		myLoader.retire(std::move(myFadingRenderer));
+	}
+}
+
+void
+TDVST::resetPlayback()
+{
+	myRenderer->reset();
+	for (auto& instance : myInstances)
+	{
+		instance->reset();
+	}
+
+	{
+		const juce::SpinLock::ScopedLockType sl(myPositionLock);
+
+		myCurrentPositionInfo.ppqPosition = 0;
+		myCurrentPositionInfo.ppqPositionOfLastBarStart = 0;
+		myCurrentPositionInfo.timeInSamples = 0;
+		myCurrentPositionInfo.timeInSeconds = 0;
+	}
+
+	myDryDelay.reset();
+	myOutputDelay.reset();
+	myRenderCache.clear();
+	myPluginMissedReplay = false;
+	myBlockFifo.reset();
+	myCatchUpBudget.reset();
+	mySkippedMidiBuffer.clear();
+}
+
+void
+TDVST::setNonRealtime(bool isNonRealtime)
+{
+	// Plugins may reallocate when switching, so not while the render thread has them.
+	const juce::ScopedLock sl(myPipeline.getRenderLock());
+
+	if (auto plugin = myRenderer->getPlugin()) {
+		if (plugin->isNonRealtime() != isNonRealtime) {
+			plugin->setNonRealtime(isNonRealtime);
+		}
+	}
+	for (auto& instance : myInstances)
+	{
+		if (auto instancePlugin = instance->getPlugin()) {
+			if (instancePlugin->isNonRealtime() != isNonRealtime) {
+				instancePlugin->setNonRealtime(isNonRealtime);
+			}
+		}
+	}
+}
+
+void
+TDVST::renderFifoBlock()
+{
+	auto& midiBuffer = myRenderer->getMidiBuffer();
+	midiBuffer.clear();
+	midiBuffer.addEvents(myBlockFifo.getBlockMidi(), 0, -1, 0);
+
+	const int numChannels = myBlockFifo.getNumChannels();
+	const int blockSize = myBlockFifo.getBlockSize();
+
+	renderBuffered(myBlockFifo.getBlockInput(), numChannels, myBlockFifo.getBlockOutput(), numChannels, blockSize);
+
+	if (myFadingRenderer) {
+		renderCrossfade(myBlockFifo.getBlockInput(), numChannels, myBlockFifo.getBlockOutput(), numChannels, blockSize,
+			mySampleRate, mySamplesPerBlock);
+	}
+
+	// The transport moves with the plugin, a block at a time.
+	advancePosition(blockSize, mySampleRate);
+
+	myBlockFifo.startNextBlock();
+}
+
+void
+TDVST::advancePosition(int numSamples, double sampleRate) {
+	const juce::SpinLock::ScopedLockType sl(myPositionLock);
+
+	myCurrentPositionInfo.timeInSamples += numSamples;
+
+	// There's no sample rate before the first cook.
+	if (sampleRate > 0.) {
+		myCurrentPositionInfo.ppqPosition = (myCurrentPositionInfo.timeInSamples / (sampleRate * 60.)) * myCurrentPositionInfo.bpm;
+	}
+}
+
+int
+TDVST::queueParameterChanges(const OP_CHOPInput* parameterCHOP, int sample, int64_t time) {
+
+	const int numValues = std::min(parameterCHOP->numChannels, (int32_t) myQueuedParameterValues.size());
+
+	int numQueued = 0;
+
+	for (int chan = 0; chan < numValues; chan++)
+	{
+		const float value = parameterCHOP->getChannelData(chan)[sample];
+
+		// A value that doesn't fit in the queue stays different, so it's tried again next block.
+		if (value != myQueuedParameterValues[chan] && myPipeline.pushParameter(time, chan, value)) {
+			myQueuedParameterValues[chan] = value;
+			numQueued++;
+		}
+	}
+
+	return numQueued;
+}
+
+void
+TDVST::renderPipelineBlock(const float* const* input, float* const* output, int numChannels, int numSamples,
+	const RenderPipeline::Event* events, int numEvents) {
+
+	using namespace juce;
+
+	if (!myRenderer->isPrepared()) {
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			FloatVectorOperations::clear(output[chan], numSamples);
+		}
+		return;
+	}
+
+	auto& midiBuffer = myRenderer->getMidiBuffer();
+	midiBuffer.clear();
+
+	float* values = myRenderer->getPendingParameterValues();
+	const int numParameters = myRenderer->getNumParameters();
+	int numValues = 0;
+
+	for (int i = 0; i < numEvents; i++)
+	{
+		const auto& event = events[i];
+
+		if (event.type == RenderPipeline::Event::Parameter) {
+			if (event.index < numParameters) {
+				values[event.index] = event.value;
+				numValues = std::max(numValues, event.index + 1);
+			}
+		}
+		else {
+			midiBuffer.addEvent(event.midiData, event.midiSize, (int)event.time);
+		}
+	}
+
+	myRenderer->pushParameters(numValues);
+
+	renderBuffered(input, numChannels, output, numChannels, numSamples);
+
+	// mySampleRate and mySamplesPerBlock belong to the cook thread.
+	if (myFadingRenderer) {
+		renderCrossfade(input, numChannels, output, numChannels, numSamples,
+			myPipeline.getSampleRate(), myPipeline.getMaximumBlockSize());
+	}
+
+	advancePosition(numSamples, myPipeline.getSampleRate());
+}
+
+int
+TDVST::getParameterSegmentLength(const OP_CHOPInput* parameterCHOP, int numParameters, int startSample, int minLength, int maxLength) const
+{
+	using namespace juce;
+
+	const int endSample = std::min(startSample + maxLength, parameterCHOP->numSamples);
+
+	if (endSample - startSample <= minLength) {
+		return maxLength;
+	}
+
+	int length = maxLength;
+
+	for (int chan = 0; chan < std::min(parameterCHOP->numChannels, numParameters); chan++)
+	{
+		const float* data = parameterCHOP->getChannelData(chan);
+
+		// Most parameters don't move, so rule those out with one vectorized pass.
+		auto range = FloatVectorOperations::findMinAndMax(data + startSample, endSample - startSample);
+		if (range.getStart() == range.getEnd()) {
+			continue;
+		}
+
+		// The segment applies the value at startSample, so split at the first
+		// sample after the minimum length that no longer matches it.
+		const float value = data[startSample];
+		const int searchEnd = std::min(startSample + length, endSample);
+
+		for (int samp = startSample + minLength; samp < searchEnd; samp++)
+		{
+			if (data[samp] != value) {
+				length = samp - startSample;
+				break;
+			}
+		}
+
+		if (length == minLength) {
+			break;
+		}
+	}
+
+	return length;
+}
+
+void
+TDVST::execute(CHOP_Output* output,
+	const OP_Inputs* inputs,
+	void* reserved)
+{
+	using namespace juce;
+
+	myExecuteCount++;
+
+	myLoader.destroyRetired();
+
+	// An offline render takes the whole input in one cook, in large blocks.
+	const bool offlineRender = inputs->getParInt("Offlinerender") != 0;
+
+	// Read the block size first so a newly loaded plugin gets prepared for it.
+	mySamplesPerBlock = inputs->getParInt(offlineRender ? "Offlineblocksize" : "Blocksize");
+
+	checkPlugin(inputs->getParFilePath("Vstfile"), inputs->getParFilePath("Fxpfile"), inputs->getParInt("Instances"),
+		inputs->getParInt("Sandbox") != 0);
+
+	// Plugins only change between cooks, so a swap always lands on a block boundary.
+	swapInLoadedRenderer(inputs);
+	applyBusLayout(inputs);
+
+	auto plugin = myRenderer->getPlugin();
+
+	if (plugin && myDoLoadPreset && !myLoader.isLoadingPlugin()) {
+		myLoader.loadPreset(inputs->getParFilePath("Fxpfile"));
+		myDoLoadPreset = false;
+	}
+
+	if (plugin && myLoader.takeLoadedPreset(myPresetData)) {
+		const ScopedLock sl(myPipeline.getRenderLock());
+
+		for (auto& instance : myInstances)
+		{
+			if (instance->getPlugin() && PluginLoader::applyPreset(instance->getPlugin(), myPresetData)) {
+				instance->invalidateParameterCache();
+			}
+		}
+
+		if (PluginLoader::applyPreset(plugin, myPresetData)) {
+			// The preset moved the parameters, so send the CHOP's values again.
+			myRenderer->invalidateParameterCache();
+			myRenderCache.clear();
+			std::fill(myQueuedParameterValues.begin(), myQueuedParameterValues.end(), std::numeric_limits<float>::quiet_NaN());
+		}
+	}
+
+	auto inputCHOP = inputs->getInputCHOP(0);
+
+	auto vstParameterCHOP = inputs->getInputCHOP(1);
+
+	auto midiCHOP = inputs->getInputCHOP(2);
+
+	auto sidechainCHOP = inputs->getInputCHOP(3);
+
+	checkPresetBank(inputs);
+	selectBankPreset(inputs);
+
+	// Menu index n oversamples by 2^n.
+	const int oversamplingLog2 = inputs->getParInt("Oversampling");
+	const auto oversamplingFilter = inputs->getParInt("Oversamplingfilter") == 0 ?
+		dsp::Oversampling<float>::filterHalfBandPolyphaseIIR : dsp::Oversampling<float>::filterHalfBandFIREquiripple;
+
+	myRenderer->setOversampling(oversamplingLog2, oversamplingFilter);
+
+	for (auto& instance : myInstances)
+	{
+		instance->setOversampling(oversamplingLog2, oversamplingFilter);
+	}
+
+	// Before preparing, since that's when VST3 plugins read it.
+	setNonRealtime(offlineRender);
+
+	// Only prepares when the sample rate, block size, oversampling, bus layout
+	// or non-realtime flag changed.
+	if (myRenderer->needsPrepare(mySampleRate, mySamplesPerBlock)) {
+		const ScopedLock sl(myPipeline.getRenderLock());
+		myRenderer->prepare(mySampleRate, mySamplesPerBlock);
+	}
+
+	for (auto& instance : myInstances)
+	{
+		instance->prepare(mySampleRate, mySamplesPerBlock);
+	}
+
+	if (offlineRender) {
+		// Every offline cook renders the input from the top, so it comes out the same each time.
+		if (myPipeline.isRunning()) {
+			myPipeline.stop();
+			myRenderer->invalidateParameterCache();
+		}
+
+		myLoader.retire(std::move(myFadingRenderer));
+		resetPlayback();
+		myNoteScanner.reset();
+		myParameterResampler.reset();
+
+		for (auto& scanner : myInstanceScanners)
+		{
+			scanner.reset();
+		}
+	}
+
+	if (!myRenderer->isPrepared()) {
+		// Output silence while there's no plugin, or while the first one loads.
+		for (int chan = 0; chan < output->numChannels; chan++)
+		{
+			FloatVectorOperations::clear(output->channels[chan], output->numSamples);
+		}
+		return;
+	}
+
+	// In the background, the cook only queues this cook's events and input, and
+	// collects audio rendered a fixed latency earlier.
+	const bool backgroundRender = !offlineRender && inputs->getParInt("Backgroundrender") != 0;
+
+	// The plugin only ever sees whole blocks, at the cost of a block of latency.
+	// In the background the pipeline waits for them, otherwise the block FIFO
+	// collects them. Several instances always render a cook at a time.
+	const bool fixedBlockSize = !offlineRender && inputs->getParInt("Fixedblocksize") != 0;
+	const bool usedBlockFifo = myUseBlockFifo;
+	myUseBlockFifo = fixedBlockSize && !backgroundRender && myInstances.empty();
+
+	if ((int)mySilentChannel.size() < output->numSamples) {
+		mySilentChannel.resize(output->numSamples, 0.f);
+	}
+
+	if (backgroundRender) {
+		// A fixed block size holds back up to a block of input, so it takes a block more.
+		const int latencySamples = mySamplesPerBlock * (inputs->getParInt("Latencyblocks") + (fixedBlockSize ? 1 : 0));
+
+		// Wide enough for the plugin's sidechain inputs as well as its outputs.
+		const int numPipelineChannels = std::max((int)output->numChannels, getNumPluginInputChannels());
+
+		if (!myPipeline.isPreparedFor(mySampleRate, numPipelineChannels, mySamplesPerBlock, latencySamples, fixedBlockSize)) {
+			// Leave a second of room for cooks that run long.
+			myPipeline.prepare(mySampleRate, numPipelineChannels, mySamplesPerBlock, latencySamples,
+				latencySamples + std::max(mySamplesPerBlock, roundToInt(mySampleRate)), fixedBlockSize);
+			std::fill(myQueuedParameterValues.begin(), myQueuedParameterValues.end(), std::numeric_limits<float>::quiet_NaN());
+		}
+	}
+	else if (myPipeline.isRunning()) {
+		myPipeline.stop();
+		myRenderer->invalidateParameterCache();
+	}
+
+	if (myUseBlockFifo) {
+		// Changing the block size or channels drops the block in progress, and
+		// anything left from when the FIFO was last used is stale.
+		const int numFifoChannels = std::max((int)output->numChannels, getNumPluginInputChannels());
+
+		if (!usedBlockFifo || !myBlockFifo.isPreparedFor(numFifoChannels, mySamplesPerBlock)) {
+			myBlockFifo.prepare(numFifoChannels, mySamplesPerBlock);
+		}
+	}
+
+	const int64_t pipelinePosition = myPipeline.getWritePosition();
+
+	auto& midiBuffer = backgroundRender || myUseBlockFifo ? myQueuedMidiBuffer : myRenderer->getMidiBuffer();
+
+	myParameterUpdateCount = 0;
+
+	const int midiInputMode = inputs->getParInt("Midiinput");
+	const bool midiIsEventList = midiCHOP && midiInputMode == 1;
+
+	// The notes held in the old mode would never see their note offs.
+	const bool allNotesOff = myMidiInputMode >= 0 && midiInputMode != myMidiInputMode;
+	myMidiInputMode = midiInputMode;
+
+	if (allNotesOff) {
+		myNoteScanner.reset();
+
+		for (auto& scanner : myInstanceScanners)
+		{
+			scanner.reset();
+		}
+
+		// Sent ahead of this cook's MIDI, along with any that was skipped.
+		// renderInstance() sends its own.
+		for (int channel = 1; channel <= 16 && myInstances.empty(); channel++)
+		{
+			mySkippedMidiBuffer.addEvent(MidiMessage::allNotesOff(channel), 0);
+		}
+	}
+
+	if (midiIsEventList) {
+		// An offline render starts over from the top, so it needs the events
+		// again even if the event CHOP hasn't cooked.
+		myEventList.read(midiCHOP, output->numSamples, offlineRender);
+	}
+
+	// From here on, a slow parameter CHOP reads as ramps at the audio rate. Sample
+	// accurate parameters then split blocks only while a parameter is moving.
+	if (vstParameterCHOP && inputs->getParInt("Interpolateparameters")) {
+		vstParameterCHOP = myParameterResampler.process(vstParameterCHOP, mySampleRate, output->numSamples);
+	}
+	else {
+		myParameterResampler.reset();
+	}
+
+	applyMorph(inputs, vstParameterCHOP, backgroundRender, pipelinePosition);
+
+	if (!myInstances.empty()) {
+		// Background rendering only runs a single instance.
+		if (myPipeline.isRunning()) {
+			myPipeline.stop();
+			myRenderer->invalidateParameterCache();
+		}
+
+		renderInstances(output, inputCHOP, vstParameterCHOP, midiCHOP, midiIsEventList, allNotesOff);
+		compensateLatency(inputs, output, inputCHOP);
+		updateCpuLoad(output->numSamples);
+
+		myParameterValuesAreStale = true;
+		return;
+	}
+
+	// Processing in place renders straight into the output channels, so the plugin
+	// needs the output to have every channel it reads or writes.
+	const bool processInPlace = !backgroundRender && !myUseBlockFifo && inputs->getParInt("Inplace") && output->numChannels >= myRenderer->getNumBufferChannels();
+
+	if (processInPlace) {
+		// Move the whole cook's input into the output up front, then process each block of it.
+		const int numInputChannels = gatherInputChannels(inputCHOP, sidechainCHOP, 0, output->numSamples);
+
+		for (int chan = 0; chan < output->numChannels; chan++)
+		{
+			if (chan < numInputChannels) {
+				FloatVectorOperations::copy(output->channels[chan], myInputChannelPointers[chan], output->numSamples);
+			}
+			else {
+				FloatVectorOperations::clear(output->channels[chan], output->numSamples);
+			}
+		}
+	}
+
+	myOutputChannelPointers.resize(output->numChannels);
+
+	// With sample accurate parameters, blocks are split wherever a parameter
+	// changes, but never into pieces shorter than the minimum sub-block. Whole
+	// blocks can't be split, and take the parameters at their first sample.
+	const bool sampleAccurate = vstParameterCHOP && !myUseBlockFifo && inputs->getParInt("Sampleaccurate");
+	const int minSubBlock = std::min(mySamplesPerBlock, (int)inputs->getParInt("Minsubblock"));
+
+	const bool sleepWhenSilent = !backgroundRender && !myUseBlockFifo && inputs->getParInt("Sleep") != 0;
+	int64_t tailSamples = 0;
+
+	if (sleepWhenSilent) {
+		mySilenceDetector.setThreshold(Decibels::decibelsToGain((float)inputs->getParDouble("Sleepthreshold")));
+
+		// An infinite tail leaves it to the output to show when the plugin has gone quiet.
+		const double tailSeconds = plugin ? plugin->getTailLengthSeconds() : 0.;
+		tailSamples = std::isfinite(tailSeconds) ? (int64_t)(std::min(tailSeconds, 60.) * mySampleRate) : 0;
+	}
+	else {
+		mySilenceDetector.reset();
+	}
+
+	bool useRenderCache = !backgroundRender && !myUseBlockFifo && inputs->getParInt("Rendercache") != 0;
+
+	if (useRenderCache) {
+		const int loopLength = roundToInt(inputs->getParDouble("Cacheloop") * mySampleRate);
+		const size_t maximumBytes = (size_t)inputs->getParInt("Cachememory") << 20;
+
+		if (!myRenderCache.isPreparedFor(output->numChannels, loopLength, mySamplesPerBlock, maximumBytes)) {
+			myRenderCache.prepare(output->numChannels, loopLength, mySamplesPerBlock, maximumBytes);
+		}
+
+		// Off if the loop doesn't fit in the memory allowed.
+		useRenderCache = myRenderCache.isEnabled();
+	}
+
+	// A cook with more to render than fits in the budget, as after dropped
+	// frames, renders what fits and fills the rest.
+	const bool protectOverload = !backgroundRender && !myUseBlockFifo && !offlineRender && inputs->getParInt("Overloadprotection") != 0;
+
+	if (protectOverload) {
+		myCatchUpBudget.prepare(output->numChannels, mySamplesPerBlock);
+		myCatchUpBudget.startCook(inputs->getParDouble("Renderbudget") / 1000., (CatchUpBudget::Shortfall)inputs->getParInt("Shortfall"));
+	}
+
+	int startSample = 0;
+
+	while (startSample < output->numSamples)
+	{
+		int bufferSize = std::min(mySamplesPerBlock, output->numSamples - startSample);
+
+		// Blocks never cross the end of the FIFO's block.
+		if (myUseBlockFifo) {
+			bufferSize = std::min(bufferSize, myBlockFifo.getNumSamplesToFill());
+		}
+
+		if (sampleAccurate) {
+			bufferSize = getParameterSegmentLength(vstParameterCHOP, plugin->getNumParameters(), startSample, minSubBlock, bufferSize);
+		}
+
+		// Cached blocks never cross the end of the loop.
+		if (useRenderCache) {
+			const int loopLength = myRenderCache.getLoopLength();
+			bufferSize = std::min(bufferSize, loopLength - (int)(myCurrentPositionInfo.timeInSamples % loopLength));
+		}
+
+		if (protectOverload && !myCatchUpBudget.canRender(bufferSize)) {
+			break;
+		}
+
+		const bool startsBlock = !myUseBlockFifo || myBlockFifo.getPosition() == 0;
+
+		if (vstParameterCHOP && startSample < vstParameterCHOP->numSamples && startsBlock) {
+			if (backgroundRender) {
+				myParameterUpdateCount += queueParameterChanges(vstParameterCHOP, startSample, pipelinePosition + startSample);
+			}
+			else {
+				const int numValues = std::min(vstParameterCHOP->numChannels, (int32_t) myRenderer->getNumParameters());
+				float* values = myRenderer->getPendingParameterValues();
+
+				for (int chan = 0; chan < numValues; chan++)
+				{
+					values[chan] = vstParameterCHOP->getChannelData(chan)[startSample];
+				}
+
+				myParameterUpdateCount += myRenderer->pushParameters(numValues);
+			}
+		}
+
+		midiBuffer.clear();
+
+		// The MIDI from the part of the last cook that was skipped.
+		for (const auto metadata : mySkippedMidiBuffer)
+		{
+			midiBuffer.addEvent(metadata.data, metadata.numBytes, 0);
+		}
+
+		mySkippedMidiBuffer.clear();
+
+		const int64_t midiStartTicks = TimingHistogram::getTicks();
+
+		if (midiIsEventList) {
+			myEventList.addBlockTo(midiBuffer, startSample, bufferSize);
+		}
+		else if (midiCHOP) {
+			myNoteScanner.scan(midiCHOP, startSample, bufferSize, midiBuffer);
+		}
+
+		if (midiCHOP) {
+			myTimings.midiBuild.record(TimingHistogram::ticksToNanoseconds(TimingHistogram::getTicks() - midiStartTicks));
+		}
+
+		if (backgroundRender) {
+			for (const auto metadata : midiBuffer)
+			{
+				myPipeline.pushMidi(pipelinePosition + startSample + metadata.samplePosition, metadata.data, metadata.numBytes);
+			}
+
+			startSample += bufferSize;
+			continue;
+		}
+
+		const int numInputChannels = gatherInputChannels(inputCHOP, sidechainCHOP, startSample, bufferSize);
+
+		for (int chan = 0; chan < output->numChannels; chan++)
+		{
+			myOutputChannelPointers[chan] = output->channels[chan] + startSample;
+		}
+
+		const float* const* input = numInputChannels > 0 ? myInputChannelPointers.data() : nullptr;
+
+		if (myUseBlockFifo) {
+			myBlockFifo.addMidi(midiBuffer);
+
+			if (myBlockFifo.exchange(input, numInputChannels, myOutputChannelPointers.data(), output->numChannels, bufferSize)) {
+				renderFifoBlock();
+			}
+
+			startSample += bufferSize;
+			continue;
+		}
+
+		// While the input and MIDI stay silent after the plugin has gone quiet, it isn't run at all.
+		const bool isAsleep = sleepWhenSilent && !myFadingRenderer && mySilenceDetector.shouldSleep(
+			midiBuffer.isEmpty() && (!input || mySilenceDetector.isSilent(input, numInputChannels, bufferSize)), bufferSize, tailSamples);
+
+		// A block whose inputs match the ones recorded at the same point of the loop is replayed.
+		const bool cacheBlock = useRenderCache && !isAsleep && !myFadingRenderer;
+		bool isReplayed = false;
+
+		const int64 renderStartTicks = protectOverload ? Time::getHighResolutionTicks() : 0;
+
+		if (cacheBlock) {
+			myRenderCache.sign(input, numInputChannels, myRenderer->getPendingParameterValues(), myRenderer->getNumParameters(), midiBuffer, bufferSize);
+			isReplayed = myRenderCache.replay(myCurrentPositionInfo.timeInSamples, myOutputChannelPointers.data(), output->numChannels, bufferSize);
+		}
+
+		if (isReplayed) {
+			myPluginMissedReplay = true;
+		}
+		else if (myPluginMissedReplay && !isAsleep) {
+			// The plugin's state is from before the replay, with any notes it
+			// started still held, so it starts over instead of carrying on.
+			myPluginMissedReplay = false;
+			myRenderer->reset();
+
+			myResyncMidiBuffer.clear();
+			for (int channel = 1; channel <= 16; channel++)
+			{
+				myResyncMidiBuffer.addEvent(MidiMessage::allNotesOff(channel), 0);
+			}
+			myResyncMidiBuffer.addEvents(midiBuffer, 0, -1, 0);
+			midiBuffer.swapWith(myResyncMidiBuffer);
+		}
+
+		if (isAsleep) {
+			for (int chan = 0; chan < output->numChannels; chan++)
+			{
+				FloatVectorOperations::clear(myOutputChannelPointers[chan], bufferSize);
+			}
+		}
+		else if (isReplayed) {
+			// Already in the output.
+		}
+		else if (processInPlace) {
+			myRenderer->process(myRenderer->getBlockBuffer(myOutputChannelPointers.data(), output->numChannels, bufferSize));
+		}
+		else {
+			renderBuffered(input, numInputChannels, myOutputChannelPointers.data(), output->numChannels, bufferSize);
+		}
+
+		if (sleepWhenSilent && !isAsleep) {
+			mySilenceDetector.outputRendered(myOutputChannelPointers.data(), output->numChannels, bufferSize);
+		}
+
+		if (cacheBlock && !isReplayed) {
+			myRenderCache.record(myCurrentPositionInfo.timeInSamples, myOutputChannelPointers.data(), output->numChannels, bufferSize);
+		}
+
+		if (myFadingRenderer) {
+			renderCrossfade(input, numInputChannels, myOutputChannelPointers.data(), output->numChannels, bufferSize,
+				mySampleRate, mySamplesPerBlock);
+		}
+
+		if (protectOverload) {
+			// Sleeping and replayed blocks cost next to nothing, so they'd throw the estimate off.
+			if (!isAsleep && !isReplayed) {
+				myCatchUpBudget.addRenderCost(bufferSize, Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - renderStartTicks));
+			}
+
+			myCatchUpBudget.blockOutput(myOutputChannelPointers.data(), output->numChannels, bufferSize);
+		}
+
+		advancePosition(bufferSize, mySampleRate);
+
+		startSample += bufferSize;
+	}
+
+	if (protectOverload && startSample < output->numSamples) {
+		// The skipped MIDI goes to the next block rendered, so no note is left hanging.
+		const int numSkippedSamples = output->numSamples - startSample;
+
+		if (midiIsEventList) {
+			myEventList.addBlockTo(mySkippedMidiBuffer, startSample, numSkippedSamples);
+		}
+		else if (midiCHOP) {
+			myNoteScanner.scan(midiCHOP, startSample, numSkippedSamples, mySkippedMidiBuffer);
+		}
+
+		myCatchUpBudget.fillShortfall(output->channels, output->numChannels, startSample, output->numSamples);
+
+		// The transport keeps time with the CHOP's output, so the next block
+		// starts where it would have if these samples had been rendered.
+		advancePosition(numSkippedSamples, mySampleRate);
+	}
+
+	if (backgroundRender) {
+		const int numInputChannels = gatherInputChannels(inputCHOP, sidechainCHOP, 0, output->numSamples);
+
+		myPipeline.process(numInputChannels > 0 ? myInputChannelPointers.data() : nullptr, numInputChannels,
+			output->channels, output->numChannels, output->numSamples);
+	}
+
+	compensateLatency(inputs, output, inputCHOP);
+	updateCpuLoad(output->numSamples);
+
+	// The Info DAT reads the new values if and when it's looked at.
+	myParameterValuesAreStale = true;
+}
+
+void
+TDVST::updateCpuLoad(int numSamples)
+{
+	// The plugin's time since the last cook, whichever threads it rendered on,
+	// over the time the cook's audio lasts.
+	const int64_t totalNanoseconds = myTimings.processBlock.getTotalNanoseconds();
+	const int64_t nanoseconds = std::max<int64_t>(0, totalNanoseconds - myLastProcessNanoseconds);
+	myLastProcessNanoseconds = totalNanoseconds;
+
+	if (numSamples <= 0 || mySampleRate <= 0.) {
+		return;
+	}
+
+	const double load = 1.0e-9 * (double)nanoseconds / (numSamples / mySampleRate);
+
+	// Smoothed over a few cooks, as the background render thread doesn't line up with them.
+	myCpuLoad += 0.2 * (load - myCpuLoad);
+}
+
+void
+TDVST::compensateLatency(const OP_Inputs* inputs, CHOP_Output* output, const OP_CHOPInput* inputCHOP)
+{
+	using namespace juce;
+
+	enum { Off, DelayDry, FixedLatency };
+
+	const int mode = inputs->getParInt("Latencycompensation");
+	const float mix = (float)inputs->getParDouble("Mix");
+
+	// The output lags the input by the plugin's latency, and by the pipeline's
+	// or the block FIFO's when they're in use. Plugins report it in their own time.
+	const int latency = myRenderer->getLatencySamples() + (myPipeline.isRunning() ? myPipeline.getLatencySamples() : 0) +
+		(myUseBlockFifo ? myBlockFifo.getLatencySamples() : 0);
+
+	if (inputCHOP && mix < 1.f) {
+		const int dryDelay = mode == Off ? 0 : latency;
+
+		for (int chan = 0; chan < output->numChannels; chan++)
+		{
+			FloatVectorOperations::multiply(output->channels[chan], mix, output->numSamples);
+		}
+
+		myInputChannelPointers.resize(inputCHOP->numChannels);
+
+		for (int chan = 0; chan < inputCHOP->numChannels; chan++)
+		{
+			myInputChannelPointers[chan] = inputCHOP->getChannelData(chan);
+		}
+
+		// A second of delay is allocated up front, so only plugins with more latency than that allocate here.
+		myDryDelay.prepare(output->numChannels, std::max(dryDelay, roundToInt(mySampleRate)));
+		myDryDelay.addDelayed(myInputChannelPointers.data(), inputCHOP->numChannels, output->channels, output->numChannels,
+			output->numSamples, dryDelay, 1.f - mix);
+	}
+
+	if (mode != FixedLatency) {
+		myCompensationDelay = 0;
+		return;
+	}
+
+	myCompensationDelay = std::max(0, (int)inputs->getParInt("Targetlatency") - latency);
+
+	myOutputDelay.prepare(output->numChannels, std::max(myCompensationDelay, roundToInt(mySampleRate)));
+	myOutputDelay.process(output->channels, output->numChannels, output->numSamples, myCompensationDelay);
+}
+
+void
+TDVST::renderInstances(CHOP_Output* output, const OP_CHOPInput* inputCHOP, const OP_CHOPInput* parameterCHOP,
+	const OP_CHOPInput* midiCHOP, bool midiIsEventList, bool allNotesOff)
+{
+	myInstanceCook = { output, inputCHOP, parameterCHOP, midiCHOP, midiIsEventList, allNotesOff };
+
+	const int numInstances = (int)myInstances.size() + 1;
+
+	for (int instance = 1; instance < numInstances; instance++)
+	{
+		myInstancePool->addJob(myInstanceJobs[instance].get(), false);
+	}
+
+	renderInstance(0);
+
+	for (int instance = 1; instance < numInstances; instance++)
+	{
+		myInstancePool->waitForJobToFinish(myInstanceJobs[instance].get(), -1);
+	}
+
+	for (int instance = 0; instance < numInstances; instance++)
+	{
+		myParameterUpdateCount += myInstanceParameterUpdates[instance];
+	}
+
+	// The instances share one transport, which moves once per cook.
+	advancePosition(output->numSamples, mySampleRate);
+}
+
+void
+TDVST::renderInstance(int instance)
+{
+	using namespace juce;
+
+	const auto& cook = myInstanceCook;
+	auto& renderer = instance == 0 ? *myRenderer : *myInstances[instance - 1];
+	auto& scanner = myInstanceScanners[instance];
+	const int numInstances = (int)myInstances.size() + 1;
+
+	myInstanceParameterUpdates[instance] = 0;
+
+	// This instance's pair of output channels.
+	const int firstChannel = 2 * instance;
+	const int numChannels = std::max(0, std::min(2, cook.output->numChannels - firstChannel));
+
+	if (!renderer.isPrepared()) {
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			FloatVectorOperations::clear(cook.output->channels[firstChannel + chan], cook.output->numSamples);
+		}
+		return;
+	}
+
+	// Each instance reads its own pair of input channels, or they all share the
+	// input if it doesn't have enough.
+	int inputChannels[2] = { 0, 0 };
+
+	if (cook.inputCHOP) {
+		for (int chan = 0; chan < 2; chan++)
+		{
+			const int groupChannel = firstChannel + chan;
+			inputChannels[chan] = groupChannel < cook.inputCHOP->numChannels ? groupChannel : std::min(chan, cook.inputCHOP->numChannels - 1);
+		}
+	}
+
+	// The parameter channels are split evenly, a slice per instance.
+	const int parametersPerInstance = cook.parameterCHOP ? cook.parameterCHOP->numChannels / numInstances : 0;
+	const int firstParameterChannel = instance * parametersPerInstance;
+	const int numValues = std::min(parametersPerInstance, renderer.getNumParameters());
+
+	// Each instance reads the next 128 velocity channels if there are enough,
+	// or the events on its own MIDI channel if the event list has channels.
+	const int firstNoteChannel = cook.midiCHOP && cook.midiCHOP->numChannels >= 128 * numInstances ? 128 * instance : 0;
+	const int eventChannel = numInstances > 1 && cook.midiIsEventList && myEventList.hasChannels() ? instance % 16 + 1 : 0;
+
+	auto& midiBuffer = renderer.getMidiBuffer();
+
+	int startSample = 0;
+
+	while (startSample < cook.output->numSamples)
+	{
+		const int bufferSize = std::min(mySamplesPerBlock, cook.output->numSamples - startSample);
+
+		if (numValues > 0 && startSample < cook.parameterCHOP->numSamples) {
+			float* values = renderer.getPendingParameterValues();
+
+			for (int i = 0; i < numValues; i++)
+			{
+				values[i] = cook.parameterCHOP->getChannelData(firstParameterChannel + i)[startSample];
+			}
+
+			myInstanceParameterUpdates[instance] += renderer.pushParameters(numValues);
+		}
+
+		midiBuffer.clear();
+
+		if (cook.allNotesOff && startSample == 0) {
+			for (int channel = 1; channel <= 16; channel++)
+			{
+				midiBuffer.addEvent(MidiMessage::allNotesOff(channel), 0);
+			}
+		}
+
+		const int64_t midiStartTicks = TimingHistogram::getTicks();
+
+		if (cook.midiIsEventList) {
+			myEventList.addBlockTo(midiBuffer, startSample, bufferSize, eventChannel);
+		}
+		else if (cook.midiCHOP) {
+			scanner.scan(cook.midiCHOP, startSample, bufferSize, midiBuffer, firstNoteChannel);
+		}
+
+		if (cook.midiCHOP) {
+			myTimings.midiBuild.record(TimingHistogram::ticksToNanoseconds(TimingHistogram::getTicks() - midiStartTicks));
+		}
+
+		auto& buffer = renderer.getBlockBuffer(bufferSize);
+
+		if (cook.inputCHOP) {
+			for (int chan = 0; chan < 2; chan++)
+			{
+				buffer.copyFrom(chan, 0, cook.inputCHOP->getChannelData(inputChannels[chan]) + startSample, bufferSize);
+			}
+		}
+		else {
+			buffer.clear();
+		}
+
+		renderer.process(buffer);
+
+		for (int chan = 0; chan < numChannels; chan++)
+		{
+			FloatVectorOperations::copy(cook.output->channels[firstChannel + chan] + startSample, buffer.getReadPointer(chan), bufferSize);
+		}
+
+		startSample += bufferSize;
+	}
+}
+
+int32_t
+TDVST::getNumInfoCHOPChans(void* reserved1)
+{
+	// We return the number of channel we want to output to any Info CHOP
+	// connected to the CHOP.
+	// The statistics are followed by a channel per parameter value.
+	refreshParameterValues();
+
+	return NumInfoCHOPStats + (int32_t)myParameterValues.size();
+}
+
+void
+TDVST::getInfoCHOPChan(int32_t index,
+	OP_InfoCHOPChan* chan,
+	void* reserved1)
+{
+	// This function will be called once for each channel we said we'd want to return
+
+	if (index == 0)
+	{
+		chan->name->setString("executeCount");
+		chan->value = (float)myExecuteCount;
+	}
+
+	if (index == 1)
+	{
+		chan->name->setString("prepareCount");
+		chan->value = (float)myRenderer->getPrepareCount();
+	}
+
+	if (index == 2)
+	{
+		chan->name->setString("parameterUpdates");
+		chan->value = (float)myParameterUpdateCount;
+	}
+
+	if (index == 3)
+	{
+		chan->name->setString("loading");
+		chan->value = myLoader.isLoadingPlugin() ? 1.f : 0.f;
+	}
+
+	if (index == 4)
+	{
+		chan->name->setString("latency");
+		chan->value = (float)myPipeline.getLatencySamples();
+	}
+
+	if (index == 5)
+	{
+		chan->name->setString("underruns");
+		chan->value = (float)myPipeline.getUnderrunCount();
+	}
+
+	if (index == 6)
+	{
+		chan->name->setString("oversamplingLatency");
+		chan->value = myRenderer->getOversamplingLatency();
+	}
+
+	if (index == 7)
+	{
+		chan->name->setString("pluginLatency");
+		chan->value = (float)myRenderer->getLatencySamples();
+	}
+
+	if (index == 8)
+	{
+		chan->name->setString("compensationDelay");
+		chan->value = (float)myCompensationDelay;
+	}
+
+	if (index == 9)
+	{
+		chan->name->setString("asleep");
+		chan->value = mySilenceDetector.isAsleep() ? 1.f : 0.f;
+	}
+
+	if (index == 10)
+	{
+		chan->name->setString("secondsAsleep");
+		chan->value = mySampleRate > 0. ? (float)(mySilenceDetector.getSamplesAsleep() / mySampleRate) : 0.f;
+	}
+
+	if (index == 11)
+	{
+		chan->name->setString("fifoLatency");
+		chan->value = myUseBlockFifo ? (float)myBlockFifo.getLatencySamples() : 0.f;
+	}
+
+	if (index == 12)
+	{
+		chan->name->setString("overloads");
+		chan->value = (float)myCatchUpBudget.getOverloadCount();
+	}
+
+	if (index == 13)
+	{
+		chan->name->setString("skippedSamples");
+		chan->value = (float)myCatchUpBudget.getSkippedSamples();
+	}
+
+	if (index == 14)
+	{
+		chan->name->setString("cpuLoad");
+		chan->value = (float)myCpuLoad;
+	}
+
+	if (index == 15)
+	{
+		chan->name->setString("blockTimeP50");
+		chan->value = (float)(myTimings.processBlock.getPercentileNanoseconds(0.5) * 1.0e-6);
+	}
+
+	if (index == 16)
+	{
+		chan->name->setString("blockTimeP99");
+		chan->value = (float)(myTimings.processBlock.getPercentileNanoseconds(0.99) * 1.0e-6);
+	}
+
+	if (index == 17)
+	{
+		chan->name->setString("blockTimeMax");
+		chan->value = (float)(myTimings.processBlock.getMaxNanoseconds() * 1.0e-6);
+	}
+
+	if (index == 18)
+	{
+		chan->name->setString("deadlineMisses");
+		chan->value = (float)myTimings.deadlineMisses.load();
+	}
+
+	if (index == 19)
+	{
+		chan->name->setString("pluginCacheHits");
+		chan->value = (float)myLoader.getCacheHits();
+	}
+
+	if (index == 20)
+	{
+		chan->name->setString("pluginCacheMisses");
+		chan->value = (float)myLoader.getCacheMisses();
+	}
+
+	if (index == 21)
+	{
+		chan->name->setString("presetBankSize");
+		chan->value = (float)myPresetBank.size();
+	}
+
+	if (index == 22)
+	{
+		chan->name->setString("renderCacheHits");
+		chan->value = (float)myRenderCache.getHits();
+	}
+
+	if (index == 23)
+	{
+		chan->name->setString("renderCacheMisses");
+		chan->value = (float)myRenderCache.getMisses();
+	}
+
+	if (index == 24)
+	{
+		chan->name->setString("renderCacheBytes");
+		chan->value = (float)myRenderCache.getNumBytes();
+	}
+
+	if (index == 25)
+	{
+		chan->name->setString("pluginInputChannels");
+		chan->value = myRenderer->getPlugin() ? (float)myRenderer->getPlugin()->getTotalNumInputChannels() : 0.f;
+	}
+
+	if (index == 26)
+	{
+		chan->name->setString("pluginOutputChannels");
+		chan->value = myRenderer->getPlugin() ? (float)myRenderer->getPlugin()->getTotalNumOutputChannels() : 0.f;
+	}
+
+	if (index == 27)
+	{
+		chan->name->setString("midiBuildP50");
+		chan->value = (float)(myTimings.midiBuild.getPercentileNanoseconds(0.5) * 1.0e-6);
+	}
+
+	if (index == 28)
+	{
+		chan->name->setString("midiBuildP99");
+		chan->value = (float)(myTimings.midiBuild.getPercentileNanoseconds(0.99) * 1.0e-6);
+	}
+
+	if (index == 29)
+	{
+		chan->name->setString("midiBuildMax");
+		chan->value = (float)(myTimings.midiBuild.getMaxNanoseconds() * 1.0e-6);
+	}
+
+	if (index == 30)
+	{
+		chan->name->setString("parameterPushP50");
+		chan->value = (float)(myTimings.parameterPush.getPercentileNanoseconds(0.5) * 1.0e-6);
+	}
+
+	if (index == 31)
+	{
+		chan->name->setString("parameterPushP99");
+		chan->value = (float)(myTimings.parameterPush.getPercentileNanoseconds(0.99) * 1.0e-6);
+	}
+
+	if (index == 32)
+	{
+		chan->name->setString("parameterPushMax");
+		chan->value = (float)(myTimings.parameterPush.getMaxNanoseconds() * 1.0e-6);
+	}
+
+	const int32_t parameter = index - NumInfoCHOPStats;
+
+	if (parameter >= 0 && parameter < (int32_t)myParameterValues.size())
+	{
+		char tempBuffer[32];
+
+#ifdef _WIN32
+		sprintf_s(tempBuffer, "param%d", parameter);
+#else // macOS
+		snprintf(tempBuffer, sizeof(tempBuffer), "param%d", parameter);
+#endif
+		chan->name->setString(tempBuffer);
+		chan->value = myParameterValues[parameter];
+	}
+}
+
+bool
+TDVST::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
+{
+	refreshParameterValues();
+
+	// A row per parameter, so the row index is the parameter index, followed by
+	// a heading row and a row per statistic.
+	infoSize->rows = (int32_t) myParameterInfo.size() + 1 + NumInfoDATStats;
+	infoSize->cols = 7;
+	// Setting this to false means we'll be assigning values to the table
+	// one row at a time. True means we'll do it one column at a time.
+	infoSize->byColumn = false;
+	return true;
+}
+
+void
+TDVST::getInfoDATEntries(int32_t index,
+	int32_t nEntries,
+	OP_InfoDATEntries* entries,
+	void* reserved1)
+{
+	const int32_t numParameters = (int32_t) myParameterInfo.size();
+
+	if (index >= numParameters) {
+		getInfoDATStat(index - numParameters - 1, entries);
+		return;
+	}
+
+	char tempBuffer[64];
+
+	const auto& info = myParameterInfo[index];
+
+	entries->values[0]->setString(info.name.c_str());
+
+	// Set the value for the second column
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%f", myParameterValues[index]);
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%f", myParameterValues[index]);
+#endif
+	entries->values[1]->setString(tempBuffer);
+
+	entries->values[2]->setString(info.label.c_str());
+
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%d", info.numSteps);
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%d", info.numSteps);
+#endif
+	entries->values[3]->setString(tempBuffer);
+
+	entries->values[4]->setString(info.minText.c_str());
+	entries->values[5]->setString(info.maxText.c_str());
+
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%f", info.defaultValue);
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%f", info.defaultValue);
+#endif
+	entries->values[6]->setString(tempBuffer);
+}
+
+void
+TDVST::getInfoDATStat(int32_t stat, OP_InfoDATEntries* entries)
+{
+	const char* name = "statistic";
+	double value = 0.;
+
+	switch (stat)
+	{
+	case PluginCacheHits:
+		name = "pluginCacheHits";
+		value = myLoader.getCacheHits();
+		break;
+	case PluginCacheMisses:
+		name = "pluginCacheMisses";
+		value = myLoader.getCacheMisses();
+		break;
+	case CpuLoad:
+		name = "cpuLoad";
+		value = myCpuLoad;
+		break;
+	case DeadlineMisses:
+		name = "deadlineMisses";
+		value = (double)myTimings.deadlineMisses.load();
+		break;
+	case BlockTimeP50:
+		name = "blockTimeP50";
+		value = myTimings.processBlock.getPercentileNanoseconds(0.5) * 1.0e-6;
+		break;
+	case BlockTimeP99:
+		name = "blockTimeP99";
+		value = myTimings.processBlock.getPercentileNanoseconds(0.99) * 1.0e-6;
+		break;
+	case BlockTimeMax:
+		name = "blockTimeMax";
+		value = myTimings.processBlock.getMaxNanoseconds() * 1.0e-6;
+		break;
+	case MidiBuildP50:
+		name = "midiBuildP50";
+		value = myTimings.midiBuild.getPercentileNanoseconds(0.5) * 1.0e-6;
+		break;
+	case MidiBuildP99:
+		name = "midiBuildP99";
+		value = myTimings.midiBuild.getPercentileNanoseconds(0.99) * 1.0e-6;
+		break;
+	case MidiBuildMax:
+		name = "midiBuildMax";
+		value = myTimings.midiBuild.getMaxNanoseconds() * 1.0e-6;
+		break;
+	case ParameterPushP50:
+		name = "parameterPushP50";
+		value = myTimings.parameterPush.getPercentileNanoseconds(0.5) * 1.0e-6;
+		break;
+	case ParameterPushP99:
+		name = "parameterPushP99";
+		value = myTimings.parameterPush.getPercentileNanoseconds(0.99) * 1.0e-6;
+		break;
+	case ParameterPushMax:
+		name = "parameterPushMax";
+		value = myTimings.parameterPush.getMaxNanoseconds() * 1.0e-6;
+		break;
+	default:
+		break;
+	}
+
+	char tempBuffer[64];
+
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%g", value);
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%g", value);
+#endif
+
+	entries->values[0]->setString(name);
+	// The heading row names the value column.
+	entries->values[1]->setString(stat < 0 ? "value" : tempBuffer);
+	for (int col = 2; col < 7; col++)
+	{
+		entries->values[col]->setString("");
+	}
+}
+
+void
+TDVST::getWarningString(OP_String* warning, void* reserved1)
+{
+	if (!myLoadError.empty()) {
+		warning->setString(myLoadError.c_str());
+		return;
+	}
+
+	auto sandboxedPlugin = dynamic_cast<SandboxedPlugin*>(myRenderer->getPlugin());
+
+	if (sandboxedPlugin && sandboxedPlugin->hasFailed()) {
+		warning->setString("The sandboxed plugin crashed or stopped responding. Reload it to restart it.");
+		return;
+	}
+
+	if (myRenderer->isBusLayoutRejected()) {
+		auto plugin = myRenderer->getPlugin();
+
+		std::stringstream ss;
+		ss << "The plugin doesn't support the requested bus layout, so it has " << plugin->getTotalNumInputChannels() <<
+			" input and " << plugin->getTotalNumOutputChannels() << " output channels.";
+		warning->setString(ss.str().c_str());
+	}
+}
+
+void
+TDVST::setupParameters(OP_ParameterManager* manager, void* reserved1)
+{
+
+	// VST File Path
+	{
+		OP_StringParameter sp;
+
+		sp.name = "Vstfile";
+		sp.label = "VST File";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// FXP File Path
+	{
+		OP_StringParameter sp;
+
+		sp.name = "Fxpfile";
+		sp.label = "FXP File";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	//// Freeze Mode
+	//{
+	//	OP_NumericParameter	np;
+
+	//	np.name = "Freeze";
+	//	np.label = "Freeze";
+	//	np.defaultValues[0] = 0;
+
+	//	OP_ParAppendResult res = manager->appendToggle(np);
+	//	assert(res == OP_ParAppendResult::Success);
+	//}
+
+	//// shape
+	//{
+	//	OP_StringParameter	sp;
+
+	//	sp.name = "Shape";
+	//	sp.label = "Shape";
+
+	//	sp.defaultValue = "Sine";
+
+	//	const char* names[] = { "Sine", "Square", "Ramp" };
+	//	const char* labels[] = { "Sine", "Square", "Ramp" };
+
+	//	OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+	//	assert(res == OP_ParAppendResult::Success);
+	//}
+
+	// pulse
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Loadfxp";
+		np.label = "Load FXP";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Width
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Samplerate";
+		np.label = "Sample Rate";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 96000;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 96000;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 44100;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Width
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Blocksize";
+		np.label = "Block Size";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 2048;
+		np.minSliders[0] = 64;
+		np.maxSliders[0] = 512;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 512;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// pulse
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Reset";
+		np.label = "Reset";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Process In Place
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Inplace";
+		np.label = "Process In Place";
+		np.defaultValues[0] = 1;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// MIDI Input
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Midiinput";
+		sp.label = "MIDI Input";
+
+		sp.defaultValue = "Velocities";
+
+		const char* names[] = { "Velocities", "Events" };
+		const char* labels[] = { "Note Velocities", "Event List" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Swap Crossfade
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Crossfade";
+		np.label = "Swap Crossfade";
+		np.minValues[0] = 0;
+		np.maxValues[0] = 1;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 1;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Sample Accurate Parameters
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sampleaccurate";
+		np.label = "Sample Accurate Parameters";
+		np.defaultValues[0] = 1;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Minimum Sub-block
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Minsubblock";
+		np.label = "Minimum Sub-block";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 2048;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 512;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 32;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Background Render
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Backgroundrender";
+		np.label = "Background Render";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Latency Blocks
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Latencyblocks";
+		np.label = "Latency Blocks";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 64;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 4;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Instances
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Instances";
+		np.label = "Instances";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 64;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 16;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 1;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Oversampling
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Oversampling";
+		sp.label = "Oversampling";
+
+		sp.defaultValue = "Off";
+
+		const char* names[] = { "Off", "X2", "X4", "X8" };
+		const char* labels[] = { "Off", "2x", "4x", "8x" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 4, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Oversampling Filter
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Oversamplingfilter";
+		sp.label = "Oversampling Filter";
+
+		sp.defaultValue = "Iir";
+
+		const char* names[] = { "Iir", "Fir" };
+		const char* labels[] = { "Polyphase IIR", "Equiripple FIR" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Dry/Wet
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Mix";
+		np.label = "Dry/Wet";
+		np.minValues[0] = 0;
+		np.maxValues[0] = 1;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 1;
 		np.clampMins[0] = true;
 		np.clampMaxes[0] = true;
-		np.defaultValues[0] = 44100;
+		np.defaultValues[0] = 1;
 
 		OP_ParAppendResult res = manager->appendFloat(np);
 		assert(res == OP_ParAppendResult::Success);
 	}
 
-	// Width
+	// Latency Compensation
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Latencycompensation";
+		sp.label = "Latency Compensation";
+
+		sp.defaultValue = "Off";
+
+		const char* names[] = { "Off", "Delaydry", "Fixedlatency" };
+		const char* labels[] = { "Off", "Delay Dry", "Fixed Latency" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Target Latency
 	{
 		OP_NumericParameter	np;
 
-		np.name = "Blocksize";
-		np.label = "Block Size";
+		np.name = "Targetlatency";
+		np.label = "Target Latency";
+		np.minValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 4096;
+		np.clampMins[0] = true;
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Offline Render
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Offlinerender";
+		np.label = "Offline Render";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Offline Block Size
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Offlineblocksize";
+		np.label = "Offline Block Size";
+		np.minValues[0] = 32;
+		np.maxValues[0] = 65536;
+		np.minSliders[0] = 32;
+		np.maxSliders[0] = 16384;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 8192;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Offline Length
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Offlinelength";
+		np.label = "Offline Length";
+		np.minValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 600;
+		np.clampMins[0] = true;
+		np.defaultValues[0] = 10;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Preset Folder
+	{
+		OP_StringParameter sp;
+
+		sp.name = "Presetfolder";
+		sp.label = "Preset Folder";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendFolder(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Preset DAT
+	{
+		OP_StringParameter sp;
+
+		sp.name = "Presetdat";
+		sp.label = "Preset DAT";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Preset Index
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Presetindex";
+		np.label = "Preset Index";
+		np.minValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 127;
+		np.clampMins[0] = true;
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Snapshot Slot
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Snapshotslot";
+		np.label = "Snapshot Slot";
+		np.minValues[0] = 0;
+		np.maxValues[0] = ParameterMorph::kNumSnapshots - 1;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = ParameterMorph::kNumSnapshots - 1;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Capture Snapshot
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Capturesnapshot";
+		np.label = "Capture Snapshot";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Morph Mode
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Morphmode";
+		sp.label = "Morph Mode";
+
+		sp.defaultValue = "Off";
+
+		const char* names[] = { "Off", "Linear", "Xy" };
+		const char* labels[] = { "Off", "Linear", "XY" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Morph
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Morph";
+		np.label = "Morph";
+
+		for (int i = 0; i < 2; i++)
+		{
+			np.minValues[i] = 0;
+			np.maxValues[i] = 1;
+			np.minSliders[i] = 0;
+			np.maxSliders[i] = 1;
+			np.clampMins[i] = true;
+			np.clampMaxes[i] = true;
+			np.defaultValues[i] = 0;
+		}
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Morph Slots
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Morphslots";
+		np.label = "Morph Slots";
 		np.minValues[0] = 1;
-		np.maxValues[0] = 2048;
-		np.minSliders[0] = 64;
+		np.maxValues[0] = ParameterMorph::kNumSnapshots;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = ParameterMorph::kNumSnapshots;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 2;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Sleep When Silent
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sleep";
+		np.label = "Sleep When Silent";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Sleep Threshold
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sleepthreshold";
+		np.label = "Sleep Threshold (dB)";
+		np.minValues[0] = -144;
+		np.maxValues[0] = 0;
+		np.minSliders[0] = -144;
+		np.maxSliders[0] = -40;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = -96;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Render Cache
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Rendercache";
+		np.label = "Render Cache";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Cache Loop Length
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cacheloop";
+		np.label = "Cache Loop Length";
+		np.minValues[0] = 0;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 16;
+		np.clampMins[0] = true;
+		np.defaultValues[0] = 2;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Cache Memory (MB)
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Cachememory";
+		np.label = "Cache Memory (MB)";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 4096;
+		np.minSliders[0] = 1;
 		np.maxSliders[0] = 512;
 		np.clampMins[0] = true;
 		np.clampMaxes[0] = true;
-		np.defaultValues[0] = 512;
+		np.defaultValues[0] = 64;
 
 		OP_ParAppendResult res = manager->appendInt(np);
 		assert(res == OP_ParAppendResult::Success);
 	}
 
-	// pulse
+	// Sandbox
 	{
 		OP_NumericParameter	np;
 
-		np.name = "Reset";
-		np.label = "Reset";
+		np.name = "Sandbox";
+		np.label = "Sandbox";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// All Buses
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Allbuses";
+		np.label = "All Buses";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Main Bus Channels
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Mainbuschannels";
+		np.label = "Main Bus Channels";
+		np.minValues[0] = 0;
+		np.maxValues[0] = 64;
+		np.minSliders[0] = 0;
+		np.maxSliders[0] = 16;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Fixed Block Size
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fixedblocksize";
+		np.label = "Fixed Block Size";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Interpolate Parameters
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Interpolateparameters";
+		np.label = "Interpolate Parameters";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Overload Protection
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Overloadprotection";
+		np.label = "Overload Protection";
+		np.defaultValues[0] = 0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Render Budget
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Renderbudget";
+		np.label = "Render Budget (ms)";
+		np.minValues[0] = 0.1;
+		np.maxValues[0] = 1000;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 33;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 10;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Fill Shortfall
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Shortfall";
+		sp.label = "Fill Shortfall";
+
+		sp.defaultValue = "Crossfade";
+
+		const char* names[] = { "Silence", "Repeat", "Crossfade" };
+		const char* labels[] = { "Silence", "Repeat Last Block", "Crossfade Last Block" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Reset Timing
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Resettiming";
+		np.label = "Reset Timing";
 
 		OP_ParAppendResult res = manager->appendPulse(np);
 		assert(res == OP_ParAppendResult::Success);
@@ -597,16 +2751,22 @@ TDVST::pulsePressed(const char* name, void* reserved1)
 {
 	if (!strcmp(name, "Reset"))
 	{
-		if (myPlugin) {
-			myPlugin->reset();
-		}
-		myCurrentPositionInfo.ppqPosition = 0;
-		myCurrentPositionInfo.ppqPositionOfLastBarStart = 0;
-		myCurrentPositionInfo.timeInSamples = 0;
-		myCurrentPositionInfo.timeInSeconds = 0;
+		const juce::ScopedLock sl(myPipeline.getRenderLock());
+		resetPlayback();
+	}
+
+	if (!strcmp(name, "Resettiming"))
+	{
+		myTimings.reset();
+		myLastProcessNanoseconds = 0;
+	}
+
+	if (!strcmp(name, "Capturesnapshot"))
+	{
+		myDoCaptureSnapshot = true;
 	}
 
-	if (!strcmp(name, "Loadfxp") && myPlugin)
+	if (!strcmp(name, "Loadfxp") && myRenderer->getPlugin())
 	{
 		myDoLoadPreset = true;
 	}
@@ -615,6 +2775,8 @@ TDVST::pulsePressed(const char* name, void* reserved1)
 
 bool
 TDVST::getCurrentPosition(juce::AudioPlayHead::CurrentPositionInfo& result) {
+	const juce::SpinLock::ScopedLockType sl(myPositionLock);
+
 	result = myCurrentPositionInfo;
 	return true;
 };
@@ -636,9 +2798,15 @@ void
 TDVST::transportRewind() {}
 
 void TDVST::shutdownPlugin() {
-	if (myPlugin) {
-		myPlugin->setPlayHead(nullptr);
-		myPlugin->releaseResources();
-		myPlugin = nullptr;
+	const juce::ScopedLock sl(myPipeline.getRenderLock());
+
+	myLoader.retire(std::move(myFadingRenderer));
+	myLoader.retire(std::move(myRenderer));
+	for (auto& instance : myInstances)
+	{
+		myLoader.retire(std::move(instance));
 	}
+	myInstances.clear();
+	myRenderer = std::make_unique<PluginRenderer>();
+	saveParameterInfo();
 }
\ No newline at end of file
@@ -17,10 +17,25 @@
 
 #include "JuceHeader.h"
 
-#include <unordered_map> 
+#include "PluginRenderer.h"
+#include "PluginLoader.h"
+#include "MidiNoteScanner.h"
+#include "MidiEventList.h"
+#include "RenderPipeline.h"
+#include "DelayLine.h"
+#include "ParameterMorph.h"
+#include "SilenceDetector.h"
+#include "RenderCache.h"
+#include "SandboxedPlugin.h"
+#include "BlockFifo.h"
+#include "ParameterResampler.h"
+#include "CatchUpBudget.h"
+#include "TimingHistogram.h"
+
+#include <vector>
 
 // To get more help about these functions, look at CHOP_CPlusPlusBase.h
-class TDVST : public CHOP_CPlusPlusBase, juce::AudioPlayHead
+class TDVST : public CHOP_CPlusPlusBase, juce::AudioPlayHead, RenderPipeline::Client
 {
 public:
 	TDVST(const OP_NodeInfo* info);
@@ -46,6 +61,8 @@ public:
 		OP_InfoDATEntries* entries,
 		void* reserved1) override;
 
+	virtual void		getWarningString(OP_String* warning, void* reserved1) override;
+
 	virtual void		setupParameters(OP_ParameterManager* manager, void* reserved1) override;
 	virtual void		pulsePressed(const char* name, void* reserved1) override;
 
@@ -56,6 +73,10 @@ public:
 	void transportRecord(bool shouldStartRecording) override;
 	void transportRewind() override;
 
+	// RenderPipeline::Client, called on the render thread.
+	void renderPipelineBlock(const float* const* input, float* const* output, int numChannels, int numSamples,
+		const RenderPipeline::Event* events, int numEvents) override;
+
 private:
 
 	// We don't need to store this pointer, but we do for the example.
@@ -67,37 +88,291 @@ private:
 	// function is called, then passes back to the CHOP 
 	int32_t				myExecuteCount;
 
+	// How many parameter values were sent to the plugin during the last cook.
+	int32_t				myParameterUpdateCount = 0;
+
 	std::string myPluginPath;
-	juce::MidiBuffer myRenderMidiBuffer;
 	double mySampleRate;
 	int mySamplesPerBlock = 0;
 	std::string emptyString = "";
 
-	bool checkPlugin(const char* pluginFilepath);
+	// True while a plugin is loading, or is about to be because the parameters changed.
+	bool isPluginPending(const OP_Inputs* inputs) const;
+
+	// Asks the loader for a new plugin when the path, number of instances or sandboxing changes.
+	void checkPlugin(const char* pluginFilepath, const char* presetFilepath, int numInstances, bool sandboxed);
+
+	// Swaps in a renderer the loader has finished, at the start of a cook.
+	void swapInLoadedRenderer(const OP_Inputs* inputs);
+
+	// Enables the plugin's buses from "All Buses" and "Main Bus Channels".
+	void applyBusLayout(const OP_Inputs* inputs);
+
+	// How many channels the plugin reads, with its main input bus widened to
+	// stereo when it's the only one. numMainChannels, if given, is set to that
+	// bus's share.
+	int getNumPluginInputChannels(int* numMainChannels = nullptr) const;
+
+	// Points myInputChannelPointers at numSamples from startSample of the input
+	// for each of the plugin's input channels, padding an input that ends sooner
+	// with silence. Returns how many there are, or 0 with no input.
+	int gatherInputChannels(const OP_CHOPInput* inputCHOP, const OP_CHOPInput* sidechainCHOP, int startSample, int numSamples);
+
+	// Renders a block through the renderer's own buffer. input may be nullptr.
+	void renderBuffered(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples);
+
+	// Renders the outgoing plugin for a block and fades the output from it. The
+	// sample rate and block size are passed in, since the render thread has to
+	// use the ones the pipeline was prepared with.
+	void renderCrossfade(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels, int numSamples,
+		double sampleRate, int blockSize);
+
+	// Renders the block FIFO's full block, then starts the next one.
+	void renderFifoBlock();
+
+	void advancePosition(int numSamples, double sampleRate);
+
+	// Resets the plugins, the transport and the compensation delays.
+	void resetPlayback();
+
+	// Switches every instance to or from its offline processing.
+	void setNonRealtime(bool isNonRealtime);
+
+	// Mixes in the dry input and lines it and the output up with the plugin's
+	// latency, as "Latency Compensation" asks, after the cook has rendered.
+	void compensateLatency(const OP_Inputs* inputs, CHOP_Output* output, const OP_CHOPInput* inputCHOP);
+
+	// Works out the plugin's CPU load from the time it spent rendering since the last cook.
+	void updateCpuLoad(int numSamples);
+
+	// How long the plugin's blocks, MIDI and parameter pushes take, from every
+	// renderer on every thread, until "Reset Timing" is pulsed.
+	RenderTimings myTimings;
+	int64_t myLastProcessNanoseconds = 0;
+
+	// The fraction of the audio's duration spent rendering it, smoothed.
+	double myCpuLoad = 0.;
+
+	// Puts the plugin to sleep while "Sleep When Silent" is on and nothing is playing.
+	SilenceDetector mySilenceDetector;
+
+	// Replays a loop of output when "Render Cache" is on and its inputs repeat.
+	// While it does, the plugin isn't run, so the first block rendered after
+	// it resets the plugin and stops its notes, using myResyncMidiBuffer to
+	// put the note offs ahead of the block's own MIDI.
+	RenderCache myRenderCache;
+	bool myPluginMissedReplay = false;
+	juce::MidiBuffer myResyncMidiBuffer;
+
+	// Regroups the cook's blocks into whole ones when "Fixed Block Size" is on
+	// and the cook renders the plugin itself.
+	BlockFifo myBlockFifo;
+	bool myUseBlockFifo = false;
+
+	// Caps the time a cook spends rendering when "Overload Protection" is on.
+	CatchUpBudget myCatchUpBudget;
+
+	// The MIDI of the samples the last cook skipped, for the next block rendered.
+	juce::MidiBuffer mySkippedMidiBuffer;
+
+	// Delays the dry input by the plugin's latency before it's mixed in.
+	DelayLine myDryDelay;
+
+	// Holds the output back so the total latency stays at "Target Latency".
+	DelayLine myOutputDelay;
+	int myCompensationDelay = 0;
+
+	// Owns the plugin. It's prepared for "Blocksize" samples and then fed blocks
+	// of up to that many samples, with the last block of a cook being shorter
+	// unless "Fixed Block Size" is on. Never null; it holds no plugin when none is loaded.
+	std::unique_ptr<PluginRenderer> myRenderer;
+
+	// The previous plugin while it's being crossfaded out after a swap.
+	std::unique_ptr<PluginRenderer> myFadingRenderer;
+	int myCrossfadeLength = 0;
+	int myCrossfadeRemaining = 0;
+
+	PluginLoader myLoader;
+	std::string myLoadError;
+
+	// With "Instances" above 1, myRenderer is the first instance and these are
+	// the rest. Each renders its own pair of channels, in parallel.
+	std::vector<std::unique_ptr<PluginRenderer>> myInstances;
+	int myNumInstances = 1;
 
-	std::unique_ptr<juce::AudioPluginInstance, std::default_delete<juce::AudioPluginInstance>> myPlugin;
+	// Whether the plugin runs in a helper process, behind a SandboxedPlugin.
+	bool mySandboxed = false;
 
-	// myBuffer always has the block size number of samples
-	juce::AudioSampleBuffer myBuffer; 
-	// myBufferSecondary has the "leftover" number of samples after myBuffer is used repeatedly.
-	juce::AudioSampleBuffer myBufferSecondary;  
+	// What the last load asked for. The values above only take these on once
+	// it succeeds, so the output keeps matching a plugin that's kept playing.
+	int myRequestedNumInstances = 1;
+	bool myRequestedSandboxed = false;
 
-	double myCookRate = 0;
+	class InstanceJob;
+
+	// Renders every instance for the cook, the first on this thread and the
+	// rest on myInstancePool.
+	void renderInstances(CHOP_Output* output, const OP_CHOPInput* inputCHOP, const OP_CHOPInput* parameterCHOP,
+		const OP_CHOPInput* midiCHOP, bool midiIsEventList, bool allNotesOff);
+
+	// Renders one instance's channels for the whole cook.
+	void renderInstance(int instance);
+
+	// What the instances render this cook.
+	struct InstanceCook
+	{
+		CHOP_Output* output;
+		const OP_CHOPInput* inputCHOP;
+		const OP_CHOPInput* parameterCHOP;
+		const OP_CHOPInput* midiCHOP;
+		bool midiIsEventList;
+		bool allNotesOff;
+	};
+
+	InstanceCook myInstanceCook = {};
+
+	// Per instance, including the first.
+	std::vector<MidiNoteScanner> myInstanceScanners;
+	std::vector<int32_t> myInstanceParameterUpdates;
+	std::vector<std::unique_ptr<InstanceJob>> myInstanceJobs;
+
+	// Created when there's more than one instance.
+	std::unique_ptr<juce::ThreadPool> myInstancePool;
+
+	// Per-block pointers into the CHOP's input and output.
+	std::vector<const float*> myInputChannelPointers;
+	std::vector<float*> myOutputChannelPointers;
+
+	// Zeros for input channels that have nothing connected, a cook long.
+	std::vector<float> mySilentChannel;
+
+	// Input channels that end before the cook does, padded with silence.
+	juce::AudioSampleBuffer myPaddedInputBuffer;
+
+	// Renders on a background thread when "Background Render" is on. Anything
+	// the render thread reads, like myRenderer, is only changed while holding
+	// its render lock.
+	RenderPipeline myPipeline;
+
+	// Ramps a parameter CHOP slower than the audio up to the audio rate, when
+	// "Interpolate Parameters" is on.
+	ParameterResampler myParameterResampler;
+
+	// The parameter values last queued for the render thread. NaN until a value
+	// has been queued, so that every value is sent to a new plugin.
+	std::vector<float> myQueuedParameterValues;
+
+	// Queues the parameter values at sample that differ from the last ones
+	// queued, and returns how many there were.
+	int queueParameterChanges(const OP_CHOPInput* parameterCHOP, int sample, int64_t time);
+
+	// A block's MIDI, before it's queued for the render thread or added to the block FIFO.
+	juce::MidiBuffer myQueuedMidiBuffer;
 
-	bool loadPreset(const std::string& path);
 	bool myDoLoadPreset = true;
+	juce::MemoryBlock myPresetData;
+
+	// Snapshots of the plugin's parameters for "Morph" to blend between.
+	ParameterMorph myMorph;
+	std::vector<float> myMorphValues;
+	bool myDoCaptureSnapshot = false;
+
+	// Captures a snapshot if one was asked for, then sends the blend of the
+	// snapshots to every instance, or queues it for the render thread. The
+	// parameter CHOP's channels take precedence over the blend.
+	void applyMorph(const OP_Inputs* inputs, const OP_CHOPInput* parameterCHOP, bool backgroundRender, int64_t time);
+
+	// Asks the loader for a new preset bank when its folder or DAT has changed.
+	void checkPresetBank(const OP_Inputs* inputs);
+
+	// Applies the bank's preset at "Preset Index" when the index, bank or plugin changes.
+	void selectBankPreset(const OP_Inputs* inputs);
+
+	// Which folder and DAT, and which cook of it, the bank was read from, and
+	// the paths that gave. A DAT cook that leaves the paths as they were
+	// doesn't read the bank again.
+	std::string myPresetFolder;
+	uint32_t myPresetDATId = 0;
+	int64_t myPresetDATCooks = -1;
+	std::vector<std::string> myPresetBankPaths;
+
+	// Presets read into memory by the loader, so switching never touches the disk.
+	std::vector<juce::MemoryBlock> myPresetBank;
+
+	// The bank preset applied to the current plugin, or -1 for none.
+	int myAppliedBankPreset = -1;
+
+	// Parameter metadata, captured once when the plugin loads.
+	struct ParameterInfo
+	{
+		std::string name;
+		std::string label;
+		int numSteps;
+		bool isDiscrete;
+		// The text the plugin shows at the ends of the normalized range, e.g. "-60 dB" and "+12 dB".
+		std::string minText;
+		std::string maxText;
+		float defaultValue;
+	};
 
 	void saveParameterInfo();
 
-	std::unordered_map<int, std::pair<std::string, float>> myParameterMap;
+	// Reads the plugin's current parameter values, but only if it has rendered
+	// since they were last read.
+	void refreshParameterValues();
 
-	bool myActiveNotes[128];
+	// Channels the Info CHOP has before the parameter values.
+	static const int32_t NumInfoCHOPStats = 33;
 
+	// Rows of the Info DAT's statistics section, which follows a heading row
+	// after the parameters.
+	enum InfoDATStat
+	{
+		PluginCacheHits = 0,
+		PluginCacheMisses,
+		CpuLoad,
+		DeadlineMisses,
+		BlockTimeP50,
+		BlockTimeP99,
+		BlockTimeMax,
+		MidiBuildP50,
+		MidiBuildP99,
+		MidiBuildMax,
+		ParameterPushP50,
+		ParameterPushP99,
+		ParameterPushMax,
+		NumInfoDATStats
+	};
+
+	void getInfoDATStat(int32_t stat, OP_InfoDATEntries* entries);
+
+	std::vector<ParameterInfo> myParameterInfo;
+	std::vector<float> myParameterValues;
+	bool myParameterValuesAreStale = true;
+
+	// Tracks which notes of the MIDI input are held.
+	MidiNoteScanner myNoteScanner;
+
+	// The MIDI input's events when "MIDI Input" is set to an event list.
+	MidiEventList myEventList;
+
+	// The "MIDI Input" mode of the last cook. Notes held when it changes are stopped.
+	int myMidiInputMode = -1;
+
+	// Plugins read the position from whichever thread renders them, while the
+	// cook thread sets the tempo and resets it, so writes and getCurrentPosition()
+	// take myPositionLock.
 	CurrentPositionInfo myCurrentPositionInfo;
+	juce::SpinLock myPositionLock;
 
 	void updatePosInfo(const OP_TimeInfo* timeInfo);
 
 	void shutdownPlugin();
 
+	// Returns how many samples from startSample can be rendered before any
+	// parameter channel moves away from its value at startSample. The result is
+	// between minLength and maxLength, unless maxLength is smaller.
+	int getParameterSegmentLength(const OP_CHOPInput* parameterCHOP, int numParameters, int startSample, int minLength, int maxLength) const;
+
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TDVST)
 };
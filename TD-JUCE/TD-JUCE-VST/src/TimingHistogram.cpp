@@ -0,0 +1,109 @@
+#include "TimingHistogram.h"
+
+TimingHistogram::TimingHistogram()
+{
+	reset();
+}
+
+void
+TimingHistogram::reset()
+{
+	for (auto& bucket : myBuckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+
+	myCount.store(0, std::memory_order_relaxed);
+	myTotal.store(0, std::memory_order_relaxed);
+	myMax.store(0, std::memory_order_relaxed);
+}
+
+int64_t
+TimingHistogram::ticksToNanoseconds(int64_t ticks)
+{
+	static const double nanosecondsPerTick = 1.0e9 / (double)juce::Time::getHighResolutionTicksPerSecond();
+	return (int64_t)((double)ticks * nanosecondsPerTick);
+}
+
+int
+TimingHistogram::getBucket(int64_t nanoseconds)
+{
+	if (nanoseconds < kNumSubBuckets) {
+		return (int)std::max<int64_t>(0, nanoseconds);
+	}
+
+	int exponent = 63;
+	while (!(nanoseconds & ((int64_t)1 << exponent)))
+	{
+		exponent--;
+	}
+
+	if (exponent > kMaxExponent) {
+		return kNumBuckets - 1;
+	}
+
+	// The bits just below the leading one pick the sub-bucket.
+	const int shift = exponent - kSubBucketBits;
+	const int subBucket = (int)((nanoseconds >> shift) & (kNumSubBuckets - 1));
+
+	return kNumSubBuckets + shift * kNumSubBuckets + subBucket;
+}
+
+int64_t
+TimingHistogram::getBucketValue(int bucket)
+{
+	if (bucket < kNumSubBuckets) {
+		return bucket;
+	}
+
+	const int shift = (bucket - kNumSubBuckets) / kNumSubBuckets;
+	const int subBucket = (bucket - kNumSubBuckets) % kNumSubBuckets;
+	const int64_t width = (int64_t)1 << shift;
+
+	return ((int64_t)(kNumSubBuckets + subBucket) << shift) + width / 2;
+}
+
+void
+TimingHistogram::record(int64_t nanoseconds)
+{
+	nanoseconds = std::max<int64_t>(0, nanoseconds);
+
+	myBuckets[(size_t)getBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	myCount.fetch_add(1, std::memory_order_relaxed);
+	myTotal.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+	int64_t max = myMax.load(std::memory_order_relaxed);
+	while (nanoseconds > max && !myMax.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+int64_t
+TimingHistogram::getPercentileNanoseconds(double fraction) const
+{
+	// Counted from the buckets rather than myCount, so the two agree.
+	int64_t count = 0;
+	for (const auto& bucket : myBuckets)
+	{
+		count += bucket.load(std::memory_order_relaxed);
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	const int64_t target = std::max<int64_t>(1, (int64_t)std::ceil(juce::jlimit(0., 1., fraction) * (double)count));
+	int64_t seen = 0;
+
+	for (int bucket = 0; bucket < kNumBuckets; bucket++)
+	{
+		seen += myBuckets[(size_t)bucket].load(std::memory_order_relaxed);
+
+		if (seen >= target) {
+			// The bucket's middle can overshoot the largest duration recorded.
+			return std::min(getBucketValue(bucket), getMaxNanoseconds());
+		}
+	}
+
+	return getMaxNanoseconds();
+}
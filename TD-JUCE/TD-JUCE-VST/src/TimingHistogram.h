@@ -0,0 +1,79 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include <array>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+
+// A histogram of durations that any number of threads can record into at once
+// without locking, while another reads it.
+//
+// Like an HDR histogram, the buckets are spaced logarithmically, with each
+// power of two split into kNumSubBuckets equal parts, so every duration from a
+// nanosecond to minutes is kept to within 1/kNumSubBuckets of its value in a
+// fixed amount of memory. The counts are relaxed atomics, so a read taken while
+// another thread records may be a sample or two behind, which doesn't matter
+// for statistics.
+class TimingHistogram
+{
+public:
+	TimingHistogram();
+
+	void record(int64_t nanoseconds);
+
+	// Clears the histogram. Records that race with it may survive.
+	void reset();
+
+	int64_t getCount() const { return myCount.load(std::memory_order_relaxed); }
+	int64_t getTotalNanoseconds() const { return myTotal.load(std::memory_order_relaxed); }
+	int64_t getMaxNanoseconds() const { return myMax.load(std::memory_order_relaxed); }
+
+	// The duration below which fraction (0 to 1) of the records fall, or 0 if
+	// there are none.
+	int64_t getPercentileNanoseconds(double fraction) const;
+
+	// The high resolution clock, for timing what gets recorded.
+	static int64_t getTicks() { return juce::Time::getHighResolutionTicks(); }
+	static int64_t ticksToNanoseconds(int64_t ticks);
+
+private:
+
+	static const int kSubBucketBits = 4;
+	static const int kNumSubBuckets = 1 << kSubBucketBits;
+
+	// Durations up to 2^kMaxExponent nanoseconds, about 9 minutes, are told apart.
+	static const int kMaxExponent = 39;
+	static const int kNumBuckets = kNumSubBuckets + (kMaxExponent - kSubBucketBits + 1) * kNumSubBuckets;
+
+	static int getBucket(int64_t nanoseconds);
+
+	// The middle of the durations a bucket holds.
+	static int64_t getBucketValue(int bucket);
+
+	std::array<std::atomic<uint32_t>, kNumBuckets> myBuckets;
+	std::atomic<int64_t> myCount { 0 };
+	std::atomic<int64_t> myTotal { 0 };
+	std::atomic<int64_t> myMax { 0 };
+};
+
+// The timings a TDVST collects from every renderer it runs, on whatever thread
+// they render on.
+struct RenderTimings
+{
+	TimingHistogram processBlock;
+	TimingHistogram midiBuild;
+	TimingHistogram parameterPush;
+
+	// Blocks whose processBlock() took longer than the audio they held lasts.
+	std::atomic<int32_t> deadlineMisses { 0 };
+
+	void reset()
+	{
+		processBlock.reset();
+		midiBuild.reset();
+		parameterPush.reset();
+		deadlineMisses = 0;
+	}
+};
@@ -0,0 +1,422 @@
+#include "PluginGraph.h"
+
+#include <cstring>
+#include <functional>
+
+const char* const PluginGraph::InputName = "in";
+const char* const PluginGraph::OutputName = "out";
+
+// Renders a node on the thread pool. It's added to the pool again for every
+// block, so it never deletes itself.
+class PluginGraph::NodeJob : public juce::ThreadPoolJob
+{
+public:
+	NodeJob(PluginGraph& graph, Node& node) : juce::ThreadPoolJob(node.name), myGraph(graph), myNode(node)
+	{
+	}
+
+	void setBlock(int numSamples, const juce::MidiBuffer* midi)
+	{
+		myNumSamples = numSamples;
+		myMidi = midi;
+	}
+
+	JobStatus runJob() override
+	{
+		myGraph.renderNode(myNode, myNumSamples, *myMidi);
+		return jobHasFinished;
+	}
+
+private:
+	PluginGraph& myGraph;
+	Node& myNode;
+
+	int myNumSamples = 0;
+	const juce::MidiBuffer* myMidi = nullptr;
+};
+
+PluginGraph::PluginGraph()
+{
+	myInputs[0] = myInputs[1] = nullptr;
+}
+
+PluginGraph::~PluginGraph()
+{
+	myThreadPool.removeAllJobs(true, -1);
+}
+
+int
+PluginGraph::findNode(const char* name, size_t nameLength) const
+{
+	for (int i = 0; i < (int)myNodes.size(); i++)
+	{
+		const auto& nodeName = myNodes[i]->name;
+
+		if (nodeName.size() == nameLength && nodeName.compare(0, nameLength, name, nameLength) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+std::string
+PluginGraph::setTopology(const std::vector<NodeSpec>& specs, double sampleRate, int blockSize, juce::AudioPlayHead* playHead)
+{
+	std::string error;
+
+	std::vector<std::unique_ptr<Node>> oldNodes;
+	oldNodes.swap(myNodes);
+
+	const NodeSpec* outputSpec = nullptr;
+	std::vector<const NodeSpec*> nodeSpecs;
+
+	for (const auto& spec : specs)
+	{
+		if (spec.name == OutputName) {
+			outputSpec = &spec;
+		}
+		else if (spec.name.empty() || spec.name == InputName) {
+			error = "Invalid node name: \"" + spec.name + "\"";
+		}
+		else if (findNode(spec.name.c_str(), spec.name.size()) >= 0) {
+			error = "Duplicate node name: " + spec.name;
+		}
+		else {
+			// Keep the plugin instance of a node that hasn't changed.
+			std::unique_ptr<Node> node;
+
+			for (auto& oldNode : oldNodes)
+			{
+				if (oldNode && oldNode->name == spec.name && oldNode->pluginPath == spec.pluginPath && oldNode->presetPath == spec.presetPath) {
+					node = std::move(oldNode);
+					break;
+				}
+			}
+
+			if (!node) {
+				node = std::make_unique<Node>();
+				node->name = spec.name;
+				node->pluginPath = spec.pluginPath;
+				node->presetPath = spec.presetPath;
+				node->renderer = std::make_unique<PluginRenderer>();
+				node->loader = std::make_unique<PluginLoader>();
+				node->job = std::make_unique<NodeJob>(*this, *node);
+
+				if (!spec.pluginPath.empty()) {
+					node->loader->loadPlugin(spec.pluginPath, spec.presetPath, sampleRate, blockSize, playHead);
+				}
+			}
+
+			myNodes.push_back(std::move(node));
+			nodeSpecs.push_back(&spec);
+		}
+	}
+
+	// A removed node's loader may be in the middle of a scan, so it's left to
+	// finish on the retiring thread instead of being waited for here.
+	for (auto& oldNode : oldNodes)
+	{
+		if (oldNode) {
+			myRetiredRenderers.retire(std::move(oldNode->renderer));
+			oldNode->loader->destroyRetired();
+			myRetiredRenderers.retire(std::move(oldNode->loader));
+		}
+	}
+
+	oldNodes.clear();
+
+	// Connect each node to its sources. With no inputs listed, a node reads the
+	// node before it, so that a plain list of plugins is a chain.
+	auto resolveSources = [this, &error](const std::vector<std::string>& inputs, int defaultSource) {
+		std::vector<int> sources;
+
+		if (inputs.empty()) {
+			sources.push_back(defaultSource);
+		}
+
+		for (const auto& input : inputs)
+		{
+			if (input == InputName) {
+				sources.push_back(kGraphInput);
+				continue;
+			}
+
+			const int source = findNode(input.c_str(), input.size());
+
+			if (source < 0) {
+				error = "Unknown input: " + input;
+			}
+			else {
+				sources.push_back(source);
+			}
+		}
+
+		return sources;
+	};
+
+	for (int i = 0; i < (int)myNodes.size(); i++)
+	{
+		myNodes[i]->sources = resolveSources(nodeSpecs[i]->inputs, i - 1);
+		myNodes[i]->level = -1;
+	}
+
+	const int lastNode = (int)myNodes.size() - 1;
+	myOutputSources = outputSpec ? resolveSources(outputSpec->inputs, lastNode) : std::vector<int>{ lastNode };
+
+	// A node's level is one past the deepest of its sources. A cycle is broken
+	// at the node it was found from.
+	enum { Unvisited, Visiting, Visited };
+	std::vector<int> state(myNodes.size(), Unvisited);
+
+	std::function<int(int)> visit = [&](int n) -> int {
+		if (n == kGraphInput) {
+			return -1;
+		}
+
+		if (state[n] == Visiting) {
+			error = "Cycle at node " + myNodes[n]->name;
+			return -1;
+		}
+
+		if (state[n] == Unvisited) {
+			state[n] = Visiting;
+
+			int level = 0;
+			for (int source : myNodes[n]->sources)
+			{
+				level = std::max(level, visit(source) + 1);
+			}
+
+			state[n] = Visited;
+			myNodes[n]->level = level;
+		}
+
+		return myNodes[n]->level;
+	};
+
+	myLevels.clear();
+
+	for (int n = 0; n < (int)myNodes.size(); n++)
+	{
+		const int level = visit(n);
+
+		if (level < 0) {
+			continue;
+		}
+
+		if (level >= (int)myLevels.size()) {
+			myLevels.resize(level + 1);
+		}
+
+		myLevels[level].push_back(n);
+	}
+
+	return error;
+}
+
+void
+PluginGraph::update(double sampleRate, int blockSize)
+{
+	if (mySilence.getNumSamples() != blockSize) {
+		mySilence.setSize(kNumChannels, blockSize);
+		mySilence.clear();
+	}
+
+	myRetiredRenderers.destroyRetired();
+
+	for (auto& node : myNodes)
+	{
+		node->loader->destroyRetired();
+
+		if (auto renderer = node->loader->takeLoadedRenderer(node->loadError)) {
+			node->loader->retire(std::move(node->renderer));
+			node->renderer = std::move(renderer);
+		}
+
+		node->renderer->prepare(sampleRate, blockSize);
+
+		if (node->mixBuffer.getNumSamples() != blockSize) {
+			node->mixBuffer.setSize(kNumChannels, blockSize);
+		}
+	}
+}
+
+const float* const*
+PluginGraph::getSourceOutputs(int source) const
+{
+	return source == kGraphInput ? myInputs : myNodes[source]->outputs;
+}
+
+void
+PluginGraph::renderNode(Node& node, int numSamples, const juce::MidiBuffer& midi)
+{
+	using namespace juce;
+
+	auto& renderer = *node.renderer;
+
+	if (renderer.isPrepared()) {
+		auto& buffer = renderer.getBlockBuffer(numSamples);
+
+		if (node.sources.empty()) {
+			buffer.clear();
+		}
+
+		// A plugin with more than two channels gets silence on the others,
+		// rather than whatever it left there last block.
+		for (int chan = kNumChannels; chan < buffer.getNumChannels() && !node.sources.empty(); chan++)
+		{
+			buffer.clear(chan, 0, numSamples);
+		}
+
+		for (size_t i = 0; i < node.sources.size(); i++)
+		{
+			const float* const* sourceOutputs = getSourceOutputs(node.sources[i]);
+
+			for (int chan = 0; chan < kNumChannels; chan++)
+			{
+				if (i == 0) {
+					buffer.copyFrom(chan, 0, sourceOutputs[chan], numSamples);
+				}
+				else {
+					buffer.addFrom(chan, 0, sourceOutputs[chan], numSamples);
+				}
+			}
+		}
+
+		auto& midiBuffer = renderer.getMidiBuffer();
+		midiBuffer.clear();
+		midiBuffer.addEvents(midi, 0, -1, 0);
+
+		renderer.process(buffer);
+
+		for (int chan = 0; chan < kNumChannels; chan++)
+		{
+			node.outputs[chan] = buffer.getReadPointer(chan);
+		}
+		return;
+	}
+
+	// Without a plugin the node passes its input through, only mixing when it has to.
+	if (node.sources.size() == 1) {
+		const float* const* sourceOutputs = getSourceOutputs(node.sources[0]);
+
+		for (int chan = 0; chan < kNumChannels; chan++)
+		{
+			node.outputs[chan] = sourceOutputs[chan];
+		}
+		return;
+	}
+
+	for (int chan = 0; chan < kNumChannels; chan++)
+	{
+		float* mix = node.mixBuffer.getWritePointer(chan);
+		FloatVectorOperations::clear(mix, numSamples);
+
+		for (int source : node.sources)
+		{
+			FloatVectorOperations::add(mix, getSourceOutputs(source)[chan], numSamples);
+		}
+
+		node.outputs[chan] = mix;
+	}
+}
+
+void
+PluginGraph::process(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels,
+	int numSamples, const juce::MidiBuffer& midi, bool parallel)
+{
+	using namespace juce;
+
+	for (int chan = 0; chan < kNumChannels; chan++)
+	{
+		myInputs[chan] = input ? input[std::min(chan, numInputChannels - 1)] : mySilence.getReadPointer(chan);
+	}
+
+	// A node that's read before it renders, because it closes a cycle, is silent.
+	for (auto& node : myNodes)
+	{
+		for (int chan = 0; chan < kNumChannels; chan++)
+		{
+			node->outputs[chan] = mySilence.getReadPointer(chan);
+		}
+	}
+
+	for (const auto& level : myLevels)
+	{
+		if (!parallel || level.size() == 1) {
+			for (int n : level)
+			{
+				renderNode(*myNodes[n], numSamples, midi);
+			}
+			continue;
+		}
+
+		// This thread renders the first node while the pool renders the rest.
+		for (size_t i = 1; i < level.size(); i++)
+		{
+			auto& job = *myNodes[level[i]]->job;
+			job.setBlock(numSamples, &midi);
+			myThreadPool.addJob(&job, false);
+		}
+
+		renderNode(*myNodes[level[0]], numSamples, midi);
+
+		for (size_t i = 1; i < level.size(); i++)
+		{
+			myThreadPool.waitForJobToFinish(myNodes[level[i]]->job.get(), -1);
+		}
+	}
+
+	for (int chan = 0; chan < numOutputChannels; chan++)
+	{
+		float* dest = output[chan];
+		const int sourceChannel = std::min(chan, kNumChannels - 1);
+
+		FloatVectorOperations::clear(dest, numSamples);
+
+		for (int source : myOutputSources)
+		{
+			FloatVectorOperations::add(dest, getSourceOutputs(source)[sourceChannel], numSamples);
+		}
+	}
+}
+
+int
+PluginGraph::getNumLoading() const
+{
+	int numLoading = 0;
+
+	for (const auto& node : myNodes)
+	{
+		if (node->loader->isLoadingPlugin()) {
+			numLoading++;
+		}
+	}
+
+	return numLoading;
+}
+
+std::string
+PluginGraph::getLoadError() const
+{
+	for (const auto& node : myNodes)
+	{
+		if (!node->loadError.empty()) {
+			return node->name + ": " + node->loadError;
+		}
+	}
+
+	return "";
+}
+
+void
+PluginGraph::reset()
+{
+	for (auto& node : myNodes)
+	{
+		if (auto plugin = node->renderer->getPlugin()) {
+			plugin->reset();
+		}
+	}
+}
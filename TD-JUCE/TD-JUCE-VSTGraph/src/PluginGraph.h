@@ -0,0 +1,129 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "PluginRenderer.h"
+#include "PluginLoader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// A graph of hosted plugins, rendered a block at a time.
+//
+// Nodes are sorted into levels so that a node only reads nodes on earlier
+// levels. The nodes on a level are independent, so they're rendered in
+// parallel on a thread pool, with the calling thread taking one of them.
+// Each node reads its sources straight out of their renderers' buffers, so
+// intermediate audio never leaves the graph.
+//
+// A node whose plugin is missing or still loading passes its input through.
+class PluginGraph
+{
+public:
+	// Where a node reads the graph's input from, instead of another node.
+	static const char* const InputName;
+	// The node that the graph's output is read from, if there is one.
+	static const char* const OutputName;
+
+	struct NodeSpec
+	{
+		std::string name;
+		std::string pluginPath;
+		std::string presetPath;
+		// Names of the nodes whose outputs are summed into this one.
+		std::vector<std::string> inputs;
+	};
+
+	PluginGraph();
+	~PluginGraph();
+
+	// Rebuilds the graph. Nodes that keep their name and plugin keep their
+	// plugin instance; the rest start loading. Returns a description of any
+	// problem with the topology, or an empty string.
+	std::string setTopology(const std::vector<NodeSpec>& specs, double sampleRate, int blockSize, juce::AudioPlayHead* playHead);
+
+	// Swaps in plugins that have finished loading and prepares them. Called
+	// between blocks.
+	void update(double sampleRate, int blockSize);
+
+	// Renders a block of up to the prepared block size. input may be nullptr.
+	void process(const float* const* input, int numInputChannels, float* const* output, int numOutputChannels,
+		int numSamples, const juce::MidiBuffer& midi, bool parallel);
+
+	int getNumNodes() const { return (int)myNodes.size(); }
+	int getNumLevels() const { return (int)myLevels.size(); }
+
+	// Returns the node's index, or -1.
+	int findNode(const char* name, size_t nameLength) const;
+
+	const std::string& getNodeName(int node) const { return myNodes[node]->name; }
+	int getNodeLevel(int node) const { return myNodes[node]->level; }
+
+	// The node's renderer, which holds no plugin until one has loaded.
+	PluginRenderer& getNodeRenderer(int node) { return *myNodes[node]->renderer; }
+
+	// How many nodes are waiting on a plugin.
+	int getNumLoading() const;
+
+	// The first plugin load error, or an empty string.
+	std::string getLoadError() const;
+
+	void reset();
+
+private:
+
+	// A source that reads the graph's input rather than a node.
+	static const int kGraphInput = -1;
+
+	// Graph audio is stereo, like the VST CHOP.
+	static const int kNumChannels = 2;
+
+	class NodeJob;
+
+	struct Node
+	{
+		std::string name;
+		std::string pluginPath;
+		std::string presetPath;
+
+		std::vector<int> sources;
+		int level = -1;
+
+		std::unique_ptr<PluginRenderer> renderer;
+		std::unique_ptr<PluginLoader> loader;
+		std::string loadError;
+
+		// Where this block's output is, either in the renderer's buffer, in
+		// mixBuffer or in a source's output.
+		const float* outputs[kNumChannels];
+		juce::AudioBuffer<float> mixBuffer;
+
+		std::unique_ptr<NodeJob> job;
+	};
+
+	// Renders one node. Safe to call in parallel for nodes on the same level.
+	void renderNode(Node& node, int numSamples, const juce::MidiBuffer& midi);
+
+	// The outputs of a source, or of the graph's input.
+	const float* const* getSourceOutputs(int source) const;
+
+	std::vector<std::unique_ptr<Node>> myNodes;
+
+	// Node indices, level by level.
+	std::vector<std::vector<int>> myLevels;
+
+	// Sources of the graph's output.
+	std::vector<int> myOutputSources;
+
+	// This block's input, or silence.
+	const float* myInputs[kNumChannels];
+	juce::AudioBuffer<float> mySilence;
+
+	// Destroys the plugins and loaders of nodes that were removed.
+	PluginLoader myRetiredRenderers;
+
+	juce::ThreadPool myThreadPool;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PluginGraph)
+};
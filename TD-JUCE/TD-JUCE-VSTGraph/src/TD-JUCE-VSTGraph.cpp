@@ -0,0 +1,550 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "TD-JUCE-VSTGraph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <sstream>
+
+// These functions are basic C function, which the DLL loader can find
+// much easier than finding a C++ Class.
+// The DLLEXPORT prefix is needed so the compile exports these functions from the .dll
+// you are creating
+extern "C"
+{
+
+	DLLEXPORT
+		void
+		FillCHOPPluginInfo(CHOP_PluginInfo* info)
+	{
+		// Always set this to CHOPCPlusPlusAPIVersion.
+		info->apiVersion = CHOPCPlusPlusAPIVersion;
+
+		// The opType is the unique name for this CHOP. It must start with a
+		// capital A-Z character, and all the following characters must lower case
+		// or numbers (a-z, 0-9)
+		info->customOPInfo.opType->setString("Vstgraph");
+
+		// The opLabel is the text that will show up in the OP Create Dialog
+		info->customOPInfo.opLabel->setString("VST Graph");
+		info->customOPInfo.opIcon->setString("VSG");
+
+		// Information about the author of this OP
+		info->customOPInfo.authorName->setString("David Braun");
+		info->customOPInfo.authorEmail->setString("github.com/dbraun");
+
+		info->customOPInfo.minInputs = 0;
+		info->customOPInfo.maxInputs = 3;  // input audio, parameters, and MIDI notes
+	}
+
+	DLLEXPORT
+		CHOP_CPlusPlusBase*
+		CreateCHOPInstance(const OP_NodeInfo* info)
+	{
+		// Return a new instance of your class every time this is called.
+		// It will be called once per CHOP that is using the .dll
+		return new TDVSTGraph(info);
+	}
+
+	DLLEXPORT
+		void
+		DestroyCHOPInstance(CHOP_CPlusPlusBase* instance)
+	{
+		// Delete the instance here, this will be called when
+		// Touch is shutting down, when the CHOP using that instance is deleted, or
+		// if the CHOP loads a different DLL
+		delete (TDVSTGraph*)instance;
+	}
+
+};
+
+
+TDVSTGraph::TDVSTGraph(const OP_NodeInfo* info) : myNodeInfo(info), mySampleRate(0.)
+{
+	myExecuteCount = 0;
+
+	// Plugins are created and destroyed on this thread.
+	PluginLoader::ensureMessageThread();
+
+	myCurrentPositionInfo.resetToDefault();
+
+	myCurrentPositionInfo.isPlaying = true;
+	myCurrentPositionInfo.isRecording = true;
+	myCurrentPositionInfo.isLooping = false;
+
+	myCurrentPositionInfo.bpm = 120.;
+	myCurrentPositionInfo.timeSigNumerator = 4;
+	myCurrentPositionInfo.timeSigDenominator = 4;
+
+	myCurrentPositionInfo.ppqPosition = 0;
+	myCurrentPositionInfo.ppqPositionOfLastBarStart = 0;
+	myCurrentPositionInfo.timeInSamples = 0;
+	myCurrentPositionInfo.timeInSeconds = 0;
+}
+
+TDVSTGraph::~TDVSTGraph()
+{
+}
+
+void
+TDVSTGraph::getGeneralInfo(CHOP_GeneralInfo* ginfo, const OP_Inputs* inputs, void* reserved1)
+{
+	// This will cause the node to cook every frame
+	ginfo->cookEveryFrameIfAsked = true;
+
+	ginfo->timeslice = true;
+
+	ginfo->inputMatchIndex = 0;
+}
+
+bool
+TDVSTGraph::getOutputInfo(CHOP_OutputInfo* info, const OP_Inputs* inputs, void* reserved1)
+{
+	auto timeInfo = inputs->getTimeInfo();
+
+	auto inputAudioCHOP = inputs->getInputCHOP(0);
+
+	if (inputAudioCHOP) {
+		mySampleRate = inputAudioCHOP->sampleRate;
+	}
+	else {
+		mySampleRate = inputs->getParDouble("Samplerate");
+	}
+
+	info->numChannels = 2;
+
+	if (inputAudioCHOP) {
+		return false;
+	}
+	else {
+		info->numSamples = (int32_t) (mySampleRate* timeInfo->deltaMS / 1000);
+		info->numChannels = 2;
+		info->sampleRate = (float) mySampleRate;
+
+		return true;
+	}
+}
+
+void
+TDVSTGraph::getChannelName(int32_t index, OP_String* name, const OP_Inputs* inputs, void* reserved1)
+{
+	std::stringstream ss;
+	ss << "chan" << (index + 1);
+	name->setString(ss.str().c_str());
+}
+
+void
+TDVSTGraph::checkTopology(const OP_DATInput* topologyDAT) {
+
+	const uint32_t opId = topologyDAT ? topologyDAT->opId : 0;
+	const int64_t totalCooks = topologyDAT ? topologyDAT->totalCooks : -1;
+
+	if (opId == myTopologyOpId && totalCooks == myTopologyCooks) {
+		return;
+	}
+
+	myTopologyOpId = opId;
+	myTopologyCooks = totalCooks;
+	myTopologyError.clear();
+
+	std::vector<PluginGraph::NodeSpec> specs;
+
+	if (topologyDAT && topologyDAT->isTable && topologyDAT->numRows > 0) {
+		// The first row names the columns.
+		int nameCol = -1, fileCol = -1, presetCol = -1, inputsCol = -1;
+
+		for (int col = 0; col < topologyDAT->numCols; col++)
+		{
+			const char* header = topologyDAT->getCell(0, col);
+
+			if (!strcmp(header, "name")) {
+				nameCol = col;
+			}
+			else if (!strcmp(header, "file")) {
+				fileCol = col;
+			}
+			else if (!strcmp(header, "preset")) {
+				presetCol = col;
+			}
+			else if (!strcmp(header, "inputs")) {
+				inputsCol = col;
+			}
+		}
+
+		if (nameCol < 0) {
+			myTopologyError = "The graph DAT needs a \"name\" column";
+		}
+		else {
+			for (int row = 1; row < topologyDAT->numRows; row++)
+			{
+				PluginGraph::NodeSpec spec;
+				spec.name = topologyDAT->getCell(row, nameCol);
+				spec.pluginPath = fileCol >= 0 ? topologyDAT->getCell(row, fileCol) : "";
+				spec.presetPath = presetCol >= 0 ? topologyDAT->getCell(row, presetCol) : "";
+
+				if (inputsCol >= 0) {
+					std::istringstream inputs(topologyDAT->getCell(row, inputsCol));
+					std::string input;
+
+					while (inputs >> input)
+					{
+						spec.inputs.push_back(input);
+					}
+				}
+
+				specs.push_back(std::move(spec));
+			}
+		}
+	}
+
+	const std::string error = myGraph.setTopology(specs, mySampleRate, mySamplesPerBlock, this);
+
+	if (myTopologyError.empty()) {
+		myTopologyError = error;
+	}
+
+	// Node indices have moved.
+	myParameterTargetsAreStale = true;
+}
+
+void
+TDVSTGraph::mapParameterChannels(const OP_CHOPInput* parameterCHOP) {
+
+	bool namesChanged = (int)myParameterChannelNames.size() != parameterCHOP->numChannels;
+
+	for (int chan = 0; chan < parameterCHOP->numChannels && !namesChanged; chan++)
+	{
+		namesChanged = myParameterChannelNames[chan] != parameterCHOP->getChannelName(chan);
+	}
+
+	if (!namesChanged && !myParameterTargetsAreStale) {
+		return;
+	}
+
+	myParameterTargetsAreStale = false;
+	myParameterChannelNames.resize(parameterCHOP->numChannels);
+	myParameterTargets.resize(parameterCHOP->numChannels);
+
+	for (int chan = 0; chan < parameterCHOP->numChannels; chan++)
+	{
+		auto& target = myParameterTargets[chan];
+		target.node = -1;
+
+		const char* name = parameterCHOP->getChannelName(chan);
+		myParameterChannelNames[chan] = name;
+
+		const char* separator = strrchr(name, ':');
+
+		if (!separator) {
+			continue;
+		}
+
+		target.node = myGraph.findNode(name, separator - name);
+		target.parameter = atoi(separator + 1);
+	}
+}
+
+void
+TDVSTGraph::execute(CHOP_Output* output,
+	const OP_Inputs* inputs,
+	void* reserved)
+{
+	using namespace juce;
+
+	myExecuteCount++;
+
+	mySamplesPerBlock = inputs->getParInt("Blocksize");
+
+	checkTopology(inputs->getParDAT("Graphdat"));
+
+	// Swaps in finished plugins, and prepares them for the current settings.
+	myGraph.update(mySampleRate, mySamplesPerBlock);
+
+	auto inputCHOP = inputs->getInputCHOP(0);
+
+	auto vstParameterCHOP = inputs->getInputCHOP(1);
+
+	auto midiCHOP = inputs->getInputCHOP(2);
+
+	if (vstParameterCHOP) {
+		mapParameterChannels(vstParameterCHOP);
+	}
+
+	const bool parallel = inputs->getParInt("Parallel") != 0;
+
+	if (inputCHOP) {
+		myInputChannelPointers.resize(inputCHOP->numChannels);
+	}
+	myOutputChannelPointers.resize(output->numChannels);
+
+	int startSample = 0;
+
+	while (startSample < output->numSamples)
+	{
+		const int bufferSize = std::min(mySamplesPerBlock, output->numSamples - startSample);
+
+		if (vstParameterCHOP && startSample < vstParameterCHOP->numSamples) {
+			for (int chan = 0; chan < vstParameterCHOP->numChannels; chan++)
+			{
+				const auto& target = myParameterTargets[chan];
+
+				if (target.node < 0) {
+					continue;
+				}
+
+				auto& renderer = myGraph.getNodeRenderer(target.node);
+
+				// Only the mapped parameter is pushed, so the ones no channel reaches keep their values.
+				if (target.parameter >= 0 && target.parameter < renderer.getNumParameters()) {
+					renderer.getPendingParameterValues()[target.parameter] = vstParameterCHOP->getChannelData(chan)[startSample];
+					renderer.pushParameters(1, target.parameter);
+				}
+			}
+		}
+
+		myMidiBuffer.clear();
+
+		if (midiCHOP) {
+			myNoteScanner.scan(midiCHOP, startSample, bufferSize, myMidiBuffer);
+		}
+
+		if (inputCHOP) {
+			for (int chan = 0; chan < inputCHOP->numChannels; chan++)
+			{
+				myInputChannelPointers[chan] = inputCHOP->getChannelData(chan) + startSample;
+			}
+		}
+
+		for (int chan = 0; chan < output->numChannels; chan++)
+		{
+			myOutputChannelPointers[chan] = output->channels[chan] + startSample;
+		}
+
+		myGraph.process(inputCHOP ? myInputChannelPointers.data() : nullptr, inputCHOP ? inputCHOP->numChannels : 0,
+			myOutputChannelPointers.data(), output->numChannels, bufferSize, myMidiBuffer, parallel);
+
+		// increment the position
+		myCurrentPositionInfo.timeInSamples += bufferSize;
+		myCurrentPositionInfo.ppqPosition = (myCurrentPositionInfo.timeInSamples / (mySampleRate * 60.)) * myCurrentPositionInfo.bpm;
+
+		startSample += bufferSize;
+	}
+}
+
+int32_t
+TDVSTGraph::getNumInfoCHOPChans(void* reserved1)
+{
+	return 4;
+}
+
+void
+TDVSTGraph::getInfoCHOPChan(int32_t index,
+	OP_InfoCHOPChan* chan,
+	void* reserved1)
+{
+	if (index == 0)
+	{
+		chan->name->setString("executeCount");
+		chan->value = (float)myExecuteCount;
+	}
+
+	if (index == 1)
+	{
+		chan->name->setString("nodes");
+		chan->value = (float)myGraph.getNumNodes();
+	}
+
+	if (index == 2)
+	{
+		chan->name->setString("levels");
+		chan->value = (float)myGraph.getNumLevels();
+	}
+
+	if (index == 3)
+	{
+		chan->name->setString("loading");
+		chan->value = (float)myGraph.getNumLoading();
+	}
+}
+
+bool
+TDVSTGraph::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
+{
+	infoSize->rows = myGraph.getNumNodes();
+	infoSize->cols = 4;
+	// Setting this to false means we'll be assigning values to the table
+	// one row at a time. True means we'll do it one column at a time.
+	infoSize->byColumn = false;
+	return true;
+}
+
+void
+TDVSTGraph::getInfoDATEntries(int32_t index,
+	int32_t nEntries,
+	OP_InfoDATEntries* entries,
+	void* reserved1)
+{
+	char tempBuffer[64];
+
+	auto& renderer = myGraph.getNodeRenderer(index);
+	auto plugin = renderer.getPlugin();
+
+	entries->values[0]->setString(myGraph.getNodeName(index).c_str());
+
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%d", myGraph.getNodeLevel(index));
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%d", myGraph.getNodeLevel(index));
+#endif
+	entries->values[1]->setString(tempBuffer);
+
+	entries->values[2]->setString(plugin ? plugin->getName().toRawUTF8() : "");
+
+#ifdef _WIN32
+	sprintf_s(tempBuffer, "%d", renderer.getNumParameters());
+#else // macOS
+	snprintf(tempBuffer, sizeof(tempBuffer), "%d", renderer.getNumParameters());
+#endif
+	entries->values[3]->setString(tempBuffer);
+}
+
+void
+TDVSTGraph::getWarningString(OP_String* warning, void* reserved1)
+{
+	const std::string loadError = myGraph.getLoadError();
+
+	if (!myTopologyError.empty()) {
+		warning->setString(myTopologyError.c_str());
+	}
+	else if (!loadError.empty()) {
+		warning->setString(loadError.c_str());
+	}
+}
+
+void
+TDVSTGraph::setupParameters(OP_ParameterManager* manager, void* reserved1)
+{
+
+	// Graph DAT
+	{
+		OP_StringParameter sp;
+
+		sp.name = "Graphdat";
+		sp.label = "Graph DAT";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Sample Rate
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Samplerate";
+		np.label = "Sample Rate";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 96000;
+		np.minSliders[0] = 1;
+		np.maxSliders[0] = 96000;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 44100;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Block Size
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Blocksize";
+		np.label = "Block Size";
+		np.minValues[0] = 1;
+		np.maxValues[0] = 2048;
+		np.minSliders[0] = 64;
+		np.maxSliders[0] = 512;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+		np.defaultValues[0] = 512;
+
+		OP_ParAppendResult res = manager->appendInt(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// pulse
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Reset";
+		np.label = "Reset";
+
+		OP_ParAppendResult res = manager->appendPulse(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// Parallel Branches
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Parallel";
+		np.label = "Parallel Branches";
+		np.defaultValues[0] = 1;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+}
+
+void
+TDVSTGraph::pulsePressed(const char* name, void* reserved1)
+{
+	if (!strcmp(name, "Reset"))
+	{
+		myGraph.reset();
+		myNoteScanner.reset();
+		myCurrentPositionInfo.ppqPosition = 0;
+		myCurrentPositionInfo.ppqPositionOfLastBarStart = 0;
+		myCurrentPositionInfo.timeInSamples = 0;
+		myCurrentPositionInfo.timeInSeconds = 0;
+	}
+}
+
+bool
+TDVSTGraph::getCurrentPosition(juce::AudioPlayHead::CurrentPositionInfo& result) {
+	result = myCurrentPositionInfo;
+	return true;
+};
+
+/** Returns true if this object can control the transport. */
+bool
+TDVSTGraph::canControlTransport() { return true; }
+
+/** Starts or stops the audio. */
+void
+TDVSTGraph::transportPlay(bool shouldStartPlaying) { }
+
+/** Starts or stops recording the audio. */
+void
+TDVSTGraph::transportRecord(bool shouldStartRecording) { }
+
+/** Rewinds the audio. */
+void
+TDVSTGraph::transportRewind() {}
@@ -0,0 +1,124 @@
+#pragma once
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "CHOP_CPlusPlusBase.h"
+
+#include "JuceHeader.h"
+
+#include "PluginGraph.h"
+#include "MidiNoteScanner.h"
+
+#include <vector>
+
+// Hosts a graph of VST plugins in one CHOP. The graph is described by a table
+// DAT with a row per node and these columns:
+//
+//   name    the node's name. A node named "out" only sets the graph's output.
+//   file    the plugin file
+//   preset  an FXP file to apply when the plugin loads (optional)
+//   inputs  names of the nodes to sum into this one, separated by spaces. "in"
+//           is the CHOP's audio input. Empty means the node in the row above,
+//           so a list of plugins is a chain.
+//
+// The output is the "out" node's inputs, or the last node. Parameter channels
+// are named "node:index", and MIDI note velocities go to every node.
+//
+// To get more help about these functions, look at CHOP_CPlusPlusBase.h
+class TDVSTGraph : public CHOP_CPlusPlusBase, juce::AudioPlayHead
+{
+public:
+	TDVSTGraph(const OP_NodeInfo* info);
+	virtual ~TDVSTGraph();
+
+	virtual void		getGeneralInfo(CHOP_GeneralInfo*, const OP_Inputs*, void*) override;
+	virtual bool		getOutputInfo(CHOP_OutputInfo*, const OP_Inputs*, void*) override;
+	virtual void		getChannelName(int32_t index, OP_String* name, const OP_Inputs*, void* reserved) override;
+
+	virtual void		execute(CHOP_Output*,
+		const OP_Inputs*,
+		void* reserved) override;
+
+
+	virtual int32_t		getNumInfoCHOPChans(void* reserved1) override;
+	virtual void		getInfoCHOPChan(int index,
+		OP_InfoCHOPChan* chan,
+		void* reserved1) override;
+
+	virtual bool		getInfoDATSize(OP_InfoDATSize* infoSize, void* resereved1) override;
+	virtual void		getInfoDATEntries(int32_t index,
+		int32_t nEntries,
+		OP_InfoDATEntries* entries,
+		void* reserved1) override;
+
+	virtual void		getWarningString(OP_String* warning, void* reserved1) override;
+
+	virtual void		setupParameters(OP_ParameterManager* manager, void* reserved1) override;
+	virtual void		pulsePressed(const char* name, void* reserved1) override;
+
+	// AudioPlayhead delegate
+	bool getCurrentPosition(juce::AudioPlayHead::CurrentPositionInfo& result) override;
+	bool canControlTransport() override;
+	void transportPlay(bool shouldStartPlaying) override;
+	void transportRecord(bool shouldStartRecording) override;
+	void transportRewind() override;
+
+private:
+
+	const OP_NodeInfo* myNodeInfo;
+
+	int32_t				myExecuteCount;
+
+	double mySampleRate;
+	int mySamplesPerBlock = 0;
+
+	PluginGraph myGraph;
+
+	// Rebuilds the graph when the topology DAT has changed.
+	void checkTopology(const OP_DATInput* topologyDAT);
+
+	// Which DAT, and which cook of it, the graph was built from.
+	uint32_t myTopologyOpId = 0;
+	int64_t myTopologyCooks = -1;
+	std::string myTopologyError;
+
+	// Maps the parameter CHOP's channels to plugin parameters.
+	void mapParameterChannels(const OP_CHOPInput* parameterCHOP);
+
+	struct ParameterTarget
+	{
+		int node;
+		int parameter;
+	};
+
+	// One per parameter channel. node is -1 if the name didn't match.
+	std::vector<ParameterTarget> myParameterTargets;
+
+	// The channel names the targets were parsed from. The targets are only
+	// rebuilt when these or the topology change.
+	std::vector<std::string> myParameterChannelNames;
+	bool myParameterTargetsAreStale = true;
+
+	// Tracks which notes of the MIDI input are held, for every node at once.
+	MidiNoteScanner myNoteScanner;
+	juce::MidiBuffer myMidiBuffer;
+
+	// Per-block pointers into the CHOP's input and output.
+	std::vector<const float*> myInputChannelPointers;
+	std::vector<float*> myOutputChannelPointers;
+
+	CurrentPositionInfo myCurrentPositionInfo;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TDVSTGraph)
+};
@@ -0,0 +1,59 @@
+#include "JuceHeader.h"
+
+#include "SandboxHost.h"
+
+// How long to wait for the render thread once the message loop has stopped.
+static const int kStopTimeoutMs = 2000;
+
+// Runs the host, then stops the message loop so main() returns.
+class RenderThread : public juce::Thread
+{
+public:
+	explicit RenderThread(SandboxHost& host)
+		: juce::Thread("TD-JUCE-VSTHost render"), myHost(host)
+	{
+	}
+
+	void run() override
+	{
+		myHost.run();
+		juce::MessageManager::getInstance()->stopDispatchLoop();
+	}
+
+private:
+
+	SandboxHost& myHost;
+};
+
+// Hosts one plugin for a TD-JUCE-VST CHOP with Sandbox on. The CHOP starts
+// it, passing the connection details on the command line, and it quits when
+// the CHOP lets go of it or goes away.
+int
+main(int argc, char* argv[])
+{
+	// This thread is the message thread. Plugins are created on it and expect
+	// it to keep dispatching messages, so it runs the message loop while the
+	// host renders on another thread.
+	juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+	juce::StringArray arguments;
+
+	for (int i = 1; i < argc; i++)
+	{
+		arguments.add(argv[i]);
+	}
+
+	SandboxHost host;
+
+	if (!host.initialiseFromCommandLine(arguments.joinIntoString(" "), SandboxProtocol::kCommandLineId)) {
+		return 1;
+	}
+
+	RenderThread renderThread(host);
+	renderThread.startThread(juce::Thread::realtimeAudioPriority);
+
+	juce::MessageManager::getInstance()->runDispatchLoop();
+
+	renderThread.stopThread(kStopTimeoutMs);
+	return 0;
+}
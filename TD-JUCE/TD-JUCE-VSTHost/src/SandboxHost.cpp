@@ -0,0 +1,397 @@
+#include "SandboxHost.h"
+
+#include "PluginCache.h"
+#include "PluginLoader.h"
+
+#include <cstring>
+
+// How long to wait for a block before checking whether anything else needs doing.
+static const int kIdleWaitMs = 100;
+
+SandboxHost::SandboxHost()
+{
+	// Random, so that helpers for different CHOPs don't collide. It's kept
+	// short, as macOS limits semaphore names to 31 characters.
+	const auto name = "tdvst-" + juce::String::toHexString(juce::Random::getSystemRandom().nextInt64());
+
+	if (mySubmittedSignal.create(name + "-s") && myCompletedSignal.create(name + "-c")) {
+		mySignalName = name;
+	}
+}
+
+SandboxHost::~SandboxHost()
+{
+	releaseMemory();
+	myRenderer.setPlugin(nullptr);
+}
+
+void
+SandboxHost::handleMessageFromMaster(const juce::MemoryBlock& message)
+{
+	auto request = juce::JSON::parse(message.toString());
+
+	{
+		const juce::ScopedLock sl(myRequestLock);
+		myRequests.push_back(request);
+	}
+
+	myIsInterrupted = true;
+	myRequestEvent.signal();
+	mySubmittedSignal.signal();
+}
+
+void
+SandboxHost::handleConnectionLost()
+{
+	myShouldExit = true;
+	myIsInterrupted = true;
+	myRequestEvent.signal();
+	mySubmittedSignal.signal();
+}
+
+void
+SandboxHost::run()
+{
+	using namespace SandboxProtocol;
+
+	while (!myShouldExit && !juce::Thread::currentThreadShouldExit())
+	{
+		handleRequests();
+
+		if (!myMemory) {
+			myRequestEvent.wait(kIdleWaitMs);
+			continue;
+		}
+
+		void* memory = myMemory->getData();
+		auto* header = getHeader(memory);
+
+		if (!mySubmittedSignal.waitFor(header->submitted, myNextBlock + 1, kIdleWaitMs, myIsInterrupted)) {
+			continue;
+		}
+
+		renderBlock(getSlot(memory, myNextBlock));
+
+		header->completed.store(++myNextBlock, std::memory_order_release);
+		myCompletedSignal.signal();
+	}
+}
+
+void
+SandboxHost::handleRequests()
+{
+	std::vector<juce::var> requests;
+
+	{
+		const juce::ScopedLock sl(myRequestLock);
+		requests.swap(myRequests);
+		myIsInterrupted = myShouldExit.load();
+	}
+
+	for (const auto& request : requests)
+	{
+		const juce::String reply = juce::JSON::toString(handleRequest(request), true);
+		sendMessageToMaster(juce::MemoryBlock(reply.toRawUTF8(), reply.getNumBytesAsUTF8()));
+	}
+}
+
+juce::var
+SandboxHost::handleRequest(const juce::var& request)
+{
+	using namespace juce;
+
+	DynamicObject::Ptr reply = new DynamicObject();
+	reply->setProperty("id", request["id"]);
+
+	const String type = request["type"].toString();
+	auto* plugin = myRenderer.getPlugin();
+
+	bool ok = false;
+
+	if (type == "load") {
+		ok = load(request, *reply);
+	}
+	else if (!plugin) {
+		reply->setProperty("error", "No plugin loaded");
+	}
+	else if (type == "prepare") {
+		ok = prepare(request["sampleRate"], request["blockSize"], *reply);
+	}
+	else if (type == "preset") {
+		MemoryBlock presetData;
+		ok = presetData.fromBase64Encoding(request["data"].toString()) && PluginLoader::applyPreset(plugin, presetData);
+		reply->setProperty("values", getParameterValues());
+	}
+	else if (type == "getState") {
+		MemoryBlock state;
+		plugin->getStateInformation(state);
+		reply->setProperty("state", state.toBase64Encoding());
+		ok = true;
+	}
+	else if (type == "setState") {
+		MemoryBlock state;
+		ok = state.fromBase64Encoding(request["state"].toString());
+
+		if (ok) {
+			plugin->setStateInformation(state.getData(), (int)state.getSize());
+		}
+
+		reply->setProperty("values", getParameterValues());
+	}
+	else if (type == "reset") {
+		plugin->reset();
+		ok = true;
+	}
+	else {
+		reply->setProperty("error", "Unknown request: " + type);
+	}
+
+	reply->setProperty("ok", ok);
+	return var(reply.get());
+}
+
+bool
+SandboxHost::load(const juce::var& request, juce::DynamicObject& reply)
+{
+	using namespace juce;
+
+	const String pluginPath = request["plugin"].toString();
+	const double sampleRate = request["sampleRate"];
+	const int blockSize = request["blockSize"];
+
+	auto& pluginCache = PluginCache::getInstance();
+
+	OwnedArray<PluginDescription> descriptions;
+	bool wasCacheHit = false;
+
+	if (mySignalName.isEmpty()) {
+		reply.setProperty("error", "Couldn't create the sandbox signals");
+		return false;
+	}
+
+	if (!File(pluginPath).exists()) {
+		reply.setProperty("error", "VST file not found: " + pluginPath);
+		return false;
+	}
+
+	if (!pluginCache.findPlugins(pluginPath, descriptions, wasCacheHit)) {
+		reply.setProperty("error", "No plugin found in " + pluginPath);
+		return false;
+	}
+
+	String error;
+	auto plugin = PluginLoader::createPluginOnMessageThread(*descriptions[0], sampleRate, blockSize, error);
+
+	if (plugin == nullptr) {
+		reply.setProperty("error", error);
+		return false;
+	}
+
+	plugin->setPlayHead(this);
+	plugin->setNonRealtime(false);
+
+	myRenderer.setPlugin(std::move(plugin));
+
+	if (!prepare(sampleRate, blockSize, reply)) {
+		return false;
+	}
+
+	auto* loadedPlugin = myRenderer.getPlugin();
+
+	MemoryBlock presetData;
+	if (PluginLoader::readPresetFile(request["preset"].toString().toStdString(), presetData)) {
+		PluginLoader::applyPreset(loadedPlugin, presetData);
+	}
+
+	const int maximumStringLength = 64;
+
+	Array<var> parameters;
+
+	for (auto* parameter : loadedPlugin->getParameters())
+	{
+		DynamicObject::Ptr info = new DynamicObject();
+		info->setProperty("name", parameter->getName(maximumStringLength));
+		info->setProperty("label", parameter->getLabel());
+		info->setProperty("numSteps", parameter->getNumSteps());
+		info->setProperty("discrete", parameter->isDiscrete());
+		info->setProperty("defaultValue", parameter->getDefaultValue());
+		parameters.add(var(info.get()));
+	}
+
+	reply.setProperty("plugin", pluginPath);
+	reply.setProperty("signals", mySignalName);
+	reply.setProperty("name", loadedPlugin->getName());
+	reply.setProperty("numInputChannels", loadedPlugin->getTotalNumInputChannels());
+	reply.setProperty("numOutputChannels", loadedPlugin->getTotalNumOutputChannels());
+	reply.setProperty("acceptsMidi", loadedPlugin->acceptsMidi());
+	reply.setProperty("producesMidi", loadedPlugin->producesMidi());
+	reply.setProperty("tailLengthSeconds", loadedPlugin->getTailLengthSeconds());
+	reply.setProperty("parameters", parameters);
+	reply.setProperty("values", getParameterValues());
+
+	return true;
+}
+
+bool
+SandboxHost::prepare(double sampleRate, int blockSize, juce::DynamicObject& reply)
+{
+	using namespace juce;
+	using namespace SandboxProtocol;
+
+	// The CHOP has already let go of the old memory.
+	releaseMemory();
+
+	myRenderer.prepare(sampleRate, blockSize);
+
+	const int numChannels = myRenderer.getNumBufferChannels();
+	const size_t size = getMemorySize(numChannels, blockSize);
+
+	// JUCE has no named shared memory, but a mapped temporary file is shared
+	// through the page cache all the same.
+	myMemoryFile = File::getSpecialLocation(File::tempDirectory).getNonexistentChildFile("TD-JUCE-VSTHost", ".shm");
+
+	const MemoryBlock zeros(size, true);
+
+	if (!myMemoryFile.replaceWithData(zeros.getData(), zeros.getSize())) {
+		reply.setProperty("error", "Couldn't create " + myMemoryFile.getFullPathName());
+		return false;
+	}
+
+	myMemory = std::make_unique<MemoryMappedFile>(myMemoryFile, MemoryMappedFile::readWrite);
+
+	if (myMemory->getData() == nullptr) {
+		releaseMemory();
+		reply.setProperty("error", "Couldn't map " + myMemoryFile.getFullPathName());
+		return false;
+	}
+
+	auto* header = getHeader(myMemory->getData());
+	header->numChannels = numChannels;
+	header->maximumBlockSize = blockSize;
+	header->numSlots = kNumSlots;
+	header->submitted = 0;
+	header->completed = 0;
+	header->magic = kMagic;
+
+	myChannels.resize((size_t)numChannels);
+	myNextBlock = 0;
+
+	reply.setProperty("memory", myMemoryFile.getFullPathName());
+	reply.setProperty("latencySamples", myRenderer.getPlugin()->getLatencySamples());
+
+	return true;
+}
+
+void
+SandboxHost::releaseMemory()
+{
+	myMemory.reset();
+
+	if (myMemoryFile != juce::File()) {
+		myMemoryFile.deleteFile();
+		myMemoryFile = juce::File();
+	}
+}
+
+void
+SandboxHost::renderBlock(SandboxProtocol::Slot* slot)
+{
+	using namespace juce;
+	using namespace SandboxProtocol;
+
+	auto* plugin = myRenderer.getPlugin();
+	void* memory = myMemory->getData();
+	const int numParameters = plugin->getNumParameters();
+
+	if ((slot->isNonRealtime != 0) != plugin->isNonRealtime()) {
+		plugin->setNonRealtime(slot->isNonRealtime != 0);
+	}
+
+	for (int i = 0; i < slot->numParameterChanges; i++)
+	{
+		const auto& change = slot->parameterChanges[i];
+
+		if (isPositiveAndBelow(change.index, numParameters)) {
+			plugin->setParameter(change.index, change.value);
+		}
+	}
+
+	auto& midiBuffer = myRenderer.getMidiBuffer();
+	midiBuffer.clear();
+
+	for (int i = 0; i < slot->numMidiEvents; i++)
+	{
+		const auto& event = slot->midiEvents[i];
+		midiBuffer.addEvent(event.data, event.numBytes, event.samplePosition);
+	}
+
+	for (int chan = 0; chan < (int)myChannels.size(); chan++)
+	{
+		myChannels[chan] = getChannel(memory, slot, chan);
+	}
+
+	mySlot = slot;
+	myRenderer.process(myRenderer.getBlockBuffer(myChannels.data(), (int)myChannels.size(), slot->numSamples));
+	mySlot = nullptr;
+
+	int numEvents = 0;
+
+	for (const auto metadata : midiBuffer)
+	{
+		if (numEvents == kMaxMidiEvents) {
+			break;
+		}
+
+		if (metadata.numBytes > (int)sizeof(MidiEvent::data)) {
+			continue;
+		}
+
+		auto& event = slot->midiEvents[numEvents++];
+		event.samplePosition = metadata.samplePosition;
+		event.numBytes = metadata.numBytes;
+		std::memcpy(event.data, metadata.data, (size_t)metadata.numBytes);
+	}
+
+	slot->numMidiEvents = numEvents;
+	slot->latencySamples = plugin->getLatencySamples();
+}
+
+bool
+SandboxHost::getCurrentPosition(CurrentPositionInfo& result)
+{
+	if (!mySlot || !mySlot->hasTransport) {
+		return false;
+	}
+
+	const auto& transport = mySlot->transport;
+
+	result.resetToDefault();
+	result.bpm = transport.bpm;
+	result.timeInSeconds = transport.timeInSeconds;
+	result.ppqPosition = transport.ppqPosition;
+	result.ppqPositionOfLastBarStart = transport.ppqPositionOfLastBarStart;
+	result.ppqLoopStart = transport.ppqLoopStart;
+	result.ppqLoopEnd = transport.ppqLoopEnd;
+	result.timeInSamples = transport.timeInSamples;
+	result.timeSigNumerator = transport.timeSigNumerator;
+	result.timeSigDenominator = transport.timeSigDenominator;
+	result.isPlaying = transport.isPlaying != 0;
+	result.isLooping = transport.isLooping != 0;
+
+	return true;
+}
+
+juce::var
+SandboxHost::getParameterValues() const
+{
+	juce::Array<juce::var> values;
+
+	if (auto* plugin = myRenderer.getPlugin()) {
+		for (auto* parameter : plugin->getParameters())
+		{
+			values.add(parameter->getValue());
+		}
+	}
+
+	return values;
+}
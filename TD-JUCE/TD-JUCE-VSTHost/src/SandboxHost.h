@@ -0,0 +1,81 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "PluginRenderer.h"
+#include "SandboxProtocol.h"
+#include "SandboxSignal.h"
+
+#include <atomic>
+#include <vector>
+
+// The helper process side of a SandboxedPlugin: hosts one plugin and renders
+// the blocks the CHOP puts in shared memory.
+//
+// Everything that touches the plugin happens on the thread that calls run(),
+// which takes requests from the connection between blocks, so a request
+// never lands in the middle of one. That's not the message thread, which has
+// to keep dispatching messages for the plugin, so plugins are only constructed
+// there.
+class SandboxHost : public juce::ChildProcessSlave, private juce::AudioPlayHead
+{
+public:
+	SandboxHost();
+	~SandboxHost() override;
+
+	// Renders blocks and answers requests until the CHOP goes away, or the
+	// calling juce::Thread is told to exit.
+	void run();
+
+	void handleMessageFromMaster(const juce::MemoryBlock& message) override;
+	void handleConnectionLost() override;
+
+private:
+
+	// Passes on the transport that came with the block being rendered.
+	bool getCurrentPosition(CurrentPositionInfo& result) override;
+
+	void handleRequests();
+	juce::var handleRequest(const juce::var& request);
+
+	bool load(const juce::var& request, juce::DynamicObject& reply);
+
+	// Prepares the plugin and makes new shared memory to fit it.
+	bool prepare(double sampleRate, int blockSize, juce::DynamicObject& reply);
+
+	void renderBlock(SandboxProtocol::Slot* slot);
+
+	juce::var getParameterValues() const;
+
+	void releaseMemory();
+
+	// Requests from the connection thread. Guarded by myRequestLock.
+	juce::CriticalSection myRequestLock;
+	std::vector<juce::var> myRequests;
+	juce::WaitableEvent myRequestEvent;
+
+	// Set when there's a request or the connection is gone, to cut a wait for
+	// the next block short. mySubmittedSignal is signalled with it.
+	std::atomic<bool> myIsInterrupted { false };
+	std::atomic<bool> myShouldExit { false };
+
+	// Made before the connection opens, so the connection thread can always
+	// signal them. mySignalName is empty if they couldn't be made.
+	SandboxSignal mySubmittedSignal;
+	SandboxSignal myCompletedSignal;
+	juce::String mySignalName;
+
+	PluginRenderer myRenderer;
+
+	juce::File myMemoryFile;
+	std::unique_ptr<juce::MemoryMappedFile> myMemory;
+	std::vector<float*> myChannels;
+
+	// The block run() waits for next.
+	uint32_t myNextBlock = 0;
+
+	// The block being rendered, while the plugin's processBlock() runs.
+	const SandboxProtocol::Slot* mySlot = nullptr;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SandboxHost)
+};